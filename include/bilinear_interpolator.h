@@ -0,0 +1,142 @@
+#ifndef BILINEAR_INTERPOLATOR_H_
+#define BILINEAR_INTERPOLATOR_H_
+
+#include "xy_point.h"
+#include <cstddef>
+#include <vector>
+
+// Instruction sets for which the interpolation kernels are compiled. By
+// default, the kernels use the best one that the CPU supports.
+enum class InstructionSet { baseline, avx2, avx512f };
+
+// Instruction sets that the kernels can use on this CPU, from the least to
+// the most capable
+std::vector<InstructionSet> supported_instruction_sets();
+
+// Use the kernels for the given instruction set, which must be supported,
+// in all interpolations (e.g., to compare the kernels in tests)
+void use_instruction_set(InstructionSet);
+
+// Batched bilinear interpolation of a pair of grids (gx, gy) whose entries
+// are known at x = 0.5, 1.5, ..., lx-0.5 and y = 0.5, 1.5, ..., ly-0.5.
+// The class reproduces interpolate_bilinearly(), which remains the reference
+// implementation: gx is interpolated with zero == 'x' and gy with
+// zero == 'y'. Instead of checking the boundary cases for every point, we
+// store the grids on a lattice that is padded by one node on each side:
+// node a = 1, ..., lx sits at x = a - 0.5, node 0 at x = 0 and node lx + 1 at
+// x = lx (and similarly for y). The padding nodes hold either 0 or the
+// value of the nearest interior node, as interpolate_bilinearly() would
+// assume, so that the kernel is free of branches and can be vectorized.
+class BilinearInterpolator
+{
+private:
+  // Values of gx and gy, interleaved, on the padded (lx_+2)*(ly_+2) lattice
+  std::vector<double> nodes_;
+  unsigned int lx_ = 0;
+  unsigned int ly_ = 0;
+
+  [[nodiscard]] std::size_t node_index(unsigned int, unsigned int) const;
+
+public:
+  BilinearInterpolator() = default;
+  BilinearInterpolator(unsigned int, unsigned int);
+
+  // Memory held by the interpolator in bytes
+  [[nodiscard]] std::size_t memory() const;
+
+  // Interpolate gx and gy at a single point
+  [[nodiscard]] XYPoint interpolate(double, double) const;
+
+  // Interpolate gx and gy at a block of points. The points must be inside
+  // [0, lx] x [0, ly].
+  void interpolate(const XYPoint *, XYPoint *, std::size_t) const;
+
+  // Fill the padding nodes. Must be called after the interior values have
+  // been set and before interpolating.
+  void pad_boundaries();
+  void set_grid_dimensions(unsigned int, unsigned int);
+
+  // Set the values of gx and gy at grid point (i, j), which sits at
+  // x = i + 0.5, y = j + 0.5
+  void set_values(const unsigned int i,
+                  const unsigned int j,
+                  const double gx,
+                  const double gy)
+  {
+    const std::size_t n = node_index(i + 1, j + 1);
+    nodes_[n] = gx;
+    nodes_[n + 1] = gy;
+  }
+};
+
+// Velocity field of the flow-based method at any time t in [0, 1],
+//   v(x, y, t) = -flux(x, y) / rho(x, y, t), with
+//   rho(x, y, t) = rho_ft(0, 0) + (1 - t) * (rho_init(x, y) - rho_ft(0, 0)).
+// The flux and the initial density are stored once, on the same padded
+// lattice as in BilinearInterpolator. The velocity is evaluated only at the
+// four nodes around each query point and then interpolated bilinearly, which
+// gives the same result as first computing the velocity on the whole grid
+// and then calling interpolate_bilinearly().
+class VelocityField
+{
+private:
+  // Values of fluxx, fluxy and rho_init, interleaved, on the padded
+  // (lx_+2)*(ly_+2) lattice
+  std::vector<double> nodes_;
+  unsigned int lx_ = 0;
+  unsigned int ly_ = 0;
+
+  // rho_ft(0, 0), i.e. the mean density, to which the density relaxes at
+  // t = 1
+  double rho_ft_00_ = 0.0;
+
+  [[nodiscard]] std::size_t node_index(unsigned int, unsigned int) const;
+
+public:
+  VelocityField() = default;
+  VelocityField(unsigned int, unsigned int);
+
+  // Memory held by the field in bytes
+  [[nodiscard]] std::size_t memory() const;
+
+  // Fill the padding nodes. Must be called after the interior values have
+  // been set and before evaluating the velocity.
+  void pad_boundaries();
+  void set_grid_dimensions(unsigned int, unsigned int);
+  void set_rho_ft_00(double);
+
+  // Set the flux and the initial density at grid point (i, j), which sits
+  // at x = i + 0.5, y = j + 0.5
+  void set_values(const unsigned int i,
+                  const unsigned int j,
+                  const double fluxx,
+                  const double fluxy,
+                  const double rho_init)
+  {
+    const std::size_t n = node_index(i + 1, j + 1);
+    nodes_[n] = fluxx;
+    nodes_[n + 1] = fluxy;
+    nodes_[n + 2] = rho_init;
+  }
+
+  // Velocity at time t at a single point
+  [[nodiscard]] XYPoint velocity(double, double, double) const;
+
+  // Velocity at time t at a block of points. The points must be inside
+  // [0, lx] x [0, ly].
+  void velocity(double, const XYPoint *, XYPoint *, std::size_t) const;
+};
+
+inline std::size_t BilinearInterpolator::node_index(const unsigned int a,
+                                                    const unsigned int b) const
+{
+  return 2 * (static_cast<std::size_t>(a) * (ly_ + 2) + b);
+}
+
+inline std::size_t VelocityField::node_index(const unsigned int a,
+                                             const unsigned int b) const
+{
+  return 3 * (static_cast<std::size_t>(a) * (ly_ + 2) + b);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef DELAUNAY_LOCATOR_H_
+#define DELAUNAY_LOCATOR_H_
+
+#include "cgal_typedef.h"
+#include "xy_point.h"
+#include <cstddef>
+#include <vector>
+
+// Methods that can be chosen on the command line to find the Delaunay
+// triangles that contain the points of the map in the Quadtree-Delaunay
+// triangulation method
+enum class DelaunayLocator {
+  cold,  // Every point is located from the same start face
+  walk,  // Walk from the face of the previous point on the ring
+  hilbert  // As walk, but points are visited in the order of a Hilbert curve
+};
+
+// Face of dt that contains p. The face is found by a visibility walk that
+// starts at the face hint. If hint is a null handle, the walk starts where
+// CGAL's locate() starts without a hint. The number of faces the walk
+// crosses is added to n_steps.
+Face_handle located_face(
+  const Delaunay &dt,
+  const Point &p,
+  Face_handle hint,
+  unsigned long &n_steps);
+
+// Indices of the points in the order in which a Hilbert curve through the
+// lx-times-ly grid visits them. Consecutive points in this order are close
+// to each other, so that a walk from the face of the previous point is
+// short. Points in the same part of the grid keep their original order.
+std::vector<std::size_t> hilbert_order(
+  const std::vector<XYPoint> &,
+  unsigned int lx,
+  unsigned int ly);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef DENSITY_RASTERIZER_H_
+#define DENSITY_RASTERIZER_H_
+
+// Methods that can be chosen on the command line to fill the grid cells
+// with density in fill_with_density()
+enum class DensityRasterizer {
+  scanline,  // default_resolution rays through every row of cells
+  adaptive,  // One ray per row, default_resolution rays in boundary cells
+  exact  // Exact area of each GeoDiv in each cell
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FFTW_THREADS_H_
+#define FFTW_THREADS_H_
+
+// Function to set the number of threads for OpenMP and FFTW. If n_threads is
+// 0, the OpenMP default is kept (e.g., from OMP_NUM_THREADS). FFTW then uses
+// the same number of threads for all plans made afterwards, provided that
+// cartogram was linked against a threaded FFTW library. Must be called
+// before any other FFTW function. Return the number of threads.
+int init_fftw_threads(unsigned int n_threads);
+
+// Return whether FFTW plans use more than one thread. If not, independent
+// transforms can instead be executed concurrently.
+bool fftw_is_multithreaded();
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef FFTW_WISDOM_H_
+#define FFTW_WISDOM_H_
+
+#include <string>
+
+// FFTW stores the plans that it found for each transform kind and size as
+// "wisdom". We keep the wisdom in a file so that the search for a good plan,
+// which can take much longer than the transform itself, is done only once
+// per machine.
+
+// Function to return the default wisdom file,
+// $XDG_CACHE_HOME/cartogram/fftw_wisdom or ~/.cache/cartogram/fftw_wisdom
+std::string default_fftw_wisdom_file_name();
+
+// Functions to load the wisdom at startup and to save it before exiting.
+// They return false if the file could not be read or written.
+bool import_fftw_wisdom(const std::string &);
+bool export_fftw_wisdom(const std::string &);
+
+// Function to convert "estimate", "measure" or "patient" to the FFTW planner
+// flag. Return false if the name is unknown.
+bool fftw_planner_flag_from_name(const std::string &, unsigned int &);
+
+#endif
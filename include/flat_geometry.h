@@ -0,0 +1,61 @@
+#ifndef FLAT_GEOMETRY_H_
+#define FLAT_GEOMETRY_H_
+
+#include "cgal_typedef.h"
+#include "geo_div.h"
+#include "xy_point.h"
+#include <cstddef>
+#include <vector>
+
+// Coordinates of all GeoDivs in one contiguous array. The CGAL polygons keep
+// each ring in its own heap allocation, which is convenient for CGAL's
+// algorithms but slow to stream through. InsetState keeps the coordinates of
+// its GeoDivs in a FlatGeometry, which the projections and the density
+// rasterizers work on directly.
+// The rings are stored in the order of the GeoDivs, their "polygons with
+// holes" and, within each polygon, the exterior ring followed by the holes.
+class FlatGeometry
+{
+private:
+  std::vector<XYPoint> points_;
+
+  // Ring r consists of the points with indices ring_offsets_[r] to
+  // ring_offsets_[r + 1] - 1. Analogously, polygon p consists of the rings
+  // pwh_offsets_[p] to pwh_offsets_[p + 1] - 1, whose first ring is the
+  // exterior ring, and GeoDiv g of the polygons geo_div_offsets_[g] to
+  // geo_div_offsets_[g + 1] - 1.
+  std::vector<std::size_t> ring_offsets_{0};
+  std::vector<std::size_t> pwh_offsets_{0};
+  std::vector<std::size_t> geo_div_offsets_{0};
+
+  // Area and bounding box of each GeoDiv, computed as in
+  // GeoDiv::update_area_and_bbox(). Non-const access to the points
+  // invalidates them until update_areas_and_bboxes() is called.
+  std::vector<double> areas_;
+  std::vector<Bbox> bboxes_;
+  bool areas_and_bboxes_are_current_ = true;
+
+  void update_area_and_bbox(std::size_t);
+
+public:
+  [[nodiscard]] double area(std::size_t) const;
+  [[nodiscard]] Bbox bbox(std::size_t) const;
+
+  // Copy the coordinates of the GeoDivs. The memory of the arrays is reused
+  // if it is large enough.
+  void assign(const std::vector<GeoDiv> &);
+  [[nodiscard]] const std::vector<std::size_t> &geo_div_offsets() const;
+  [[nodiscard]] std::size_t n_geo_divs() const;
+  [[nodiscard]] const std::vector<std::size_t> &pwh_offsets() const;
+  [[nodiscard]] const std::vector<std::size_t> &ring_offsets() const;
+  [[nodiscard]] const std::vector<XYPoint> &points() const;
+  std::vector<XYPoint> *ref_to_points();
+  void update_areas_and_bboxes();
+
+  // Copy the points back into the GeoDivs from which they were read. The
+  // number of rings and points of the GeoDivs must not have changed. The
+  // areas and bounding boxes of the GeoDivs are updated.
+  void write_to(std::vector<GeoDiv> &) const;
+};
+
+#endif
@@ -16,7 +16,10 @@ public:
   void set_array_size(unsigned int, unsigned int);
   void allocate(unsigned int, unsigned int);
   void free();
-  void make_fftw_plan(fftw_r2r_kind, fftw_r2r_kind);
+
+  // Make an in-place plan. The planner flag must be FFTW_ESTIMATE if the
+  // array already holds data because the other flags overwrite it.
+  void make_fftw_plan(fftw_r2r_kind, fftw_r2r_kind, unsigned int);
   void execute_fftw_plan();
   void destroy_fftw_plan();
 
@@ -27,4 +30,11 @@ public:
   double operator()(unsigned int, unsigned int) const;
 };
 
+// Return whether n is of the form 2^a * 3^b * 5^c * 7^d. FFTW transforms
+// arrays with such dimensions efficiently.
+bool is_fft_friendly(unsigned int);
+
+// Return the smallest FFT-friendly integer that is at least n
+unsigned int fft_friendly_size(unsigned int);
+
 #endif
@@ -12,25 +12,48 @@ class GeoDiv
 private:
   std::set<std::string> adjacent_geodivs_;
   std::string id_;
+
+  // Index of id_ in the dense attribute arrays of the InsetState, assigned
+  // when the ID is first read from the CSV
+  unsigned int id_index_ = 0;
   std::vector<Polygon_with_holes> polygons_with_holes_;
+
+  // Area and bounding box of polygons_with_holes_, stored by
+  // update_area_and_bbox(). Non-const access to the polygons invalidates
+  // them.
+  double area_ = 0.0;
+  Bbox bbox_;
+  bool area_and_bbox_are_current_ = false;
   GeoDiv();
 
 public:
-  explicit GeoDiv(std::string);
-  [[nodiscard]] std::set<std::string> adjacent_geodivs() const;
+  GeoDiv(std::string, unsigned int);
+  [[nodiscard]] const std::set<std::string> &adjacent_geodivs() const;
   void adjacent_to(const std::string &);
   [[nodiscard]] double area() const;
-  [[nodiscard]] std::string id() const;
-  [[nodiscard]] Polygon_with_holes largest_polygon_with_holes() const;
+  [[nodiscard]] Bbox bbox() const;
+  [[nodiscard]] const std::string &id() const;
+  [[nodiscard]] unsigned int id_index() const;
+  [[nodiscard]] const Polygon_with_holes &largest_polygon_with_holes() const;
   [[nodiscard]] unsigned int n_points() const;
   [[nodiscard]] unsigned int n_rings() const;
   [[nodiscard]] Point point_on_surface_of_geodiv() const;
   [[nodiscard]] Point point_on_surface_of_polygon_with_holes(
     const Polygon_with_holes &) const;
-  [[nodiscard]] std::vector<Polygon_with_holes> polygons_with_holes() const;
+  [[nodiscard]] const std::vector<Polygon_with_holes> &polygons_with_holes()
+    const;
   void push_back(const Polygon_with_holes &);
   std::vector<Polygon_with_holes> *ref_to_polygons_with_holes();
+
+  // Store an area and a bounding box that have been computed elsewhere (by
+  // FlatGeometry) from the current polygons
+  void set_area_and_bbox(double, Bbox);
   void sort_pwh_descending_by_area();
+
+  // Compute the area and the bounding box in one pass over the vertices.
+  // area() and bbox() return the stored values until the polygons are
+  // modified.
+  void update_area_and_bbox();
 };
 
 #endif
@@ -2,15 +2,24 @@
 #define INSET_STATE_H_
 
 #include "colors.h"
+#include "delaunay_locator.h"
+#include "density_rasterizer.h"
+#include "flat_geometry.h"
 #include "ft_real_2d.h"
 #include "geo_div.h"
+#include "integration_workspace.h"
+#include "integrator.h"
 #include "intersection.h"
+#include "rasterizer_buffers.h"
 #include "xy_point.h"
 #include <boost/multi_array.hpp>
+#include <algorithm>
 #include <cairo/cairo.h>
 #include <functional>
 #include <map>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <vector>
 
 // TODO: Transfer this struct to colors.h
@@ -18,9 +27,20 @@ struct color {
   double r, g, b;
 };
 
+// The GeoDiv is given by the index of its ID (see InsetState::id_at()), so
+// that no string is copied in every integration.
 struct max_area_error_info {
   double value;
-  std::string geo_div;
+  unsigned int geo_div;
+};
+
+// A graticule cell of the triangulation, split by its chosen diagonal into
+// two triangles. maps[k] is the affine map of triangle k, which sends
+// (x, y) to (maps[k][0] x + maps[k][1] y + maps[k][2],
+// maps[k][3] x + maps[k][4] y + maps[k][5]).
+struct triangulated_cell {
+  int diag;
+  double maps[2][6];
 };
 
 struct proj_qd {  // quadtree-delaunay projection
@@ -31,35 +51,71 @@ struct proj_qd {  // quadtree-delaunay projection
 class InsetState
 {
 private:
-  std::unordered_map<std::string, double> area_errors_;
+  // GeoDiv IDs are interned when they are read from the CSV. The attributes
+  // of the GeoDiv whose ID has index k (e.g., its target area) are stored at
+  // index k of the arrays below, so that no strings are hashed during the
+  // integration. id_indices_ is only needed to look up the index of an ID
+  // while reading or writing files.
+  std::unordered_map<std::string, unsigned int> id_indices_;
+  std::vector<std::string> ids_;
+  std::vector<double> area_errors_;
+  std::vector<std::optional<Color> > colors_;
+  unsigned int n_colors_ = 0;
+  std::vector<bool> is_input_target_area_missing_;
+  std::vector<std::string> labels_;
+  std::vector<double> target_areas_;
+
   std::unordered_set<Point> unique_quadtree_corners_;
   proj_qd proj_qd_;
-  std::vector<proj_qd> proj_sequence_;
 
   Bbox bbox_;  // Bounding box
   fftw_plan bwd_plan_for_rho_{};
-  std::unordered_map<std::string, Color> colors_;
+
+  // Buffers and FFTW plans for flatten_density(). They can be shared with
+  // other insets.
+  std::shared_ptr<IntegrationWorkspace> integration_workspace_;
 
   // Cumulative cartogram projection
   boost::multi_array<XYPoint, 2> cum_proj_;
   fftw_plan fwd_plan_for_rho_{};
 
-  // Geographic divisions in this inset
+  // Geographic divisions in this inset and a copy of the original data.
+  // The coordinates are kept twice: in the CGAL polygons of the GeoDivs,
+  // which are needed to densify, simplify, check and write the GeoDivs, and
+  // in a FlatGeometry, which the projections update in place and from which
+  // the areas, bounding boxes and densities are computed. At most one of the
+  // two copies is out of date. ref_to_geo_divs() and ref_to_flat_geo_divs()
+  // bring their copy up to date before they return it, and the copies are
+  // only synchronized at the end of the stages that change the polygons
+  // (e.g., simplify()) and at the start of the stages that read them (e.g.,
+  // the writers), so that the coordinates are not copied in every
+  // integration. Every stage leaves the flat coordinates up to date. The
+  // IDs, adjacencies and numbers of points of geo_divs_ are always up to
+  // date.
+  enum class UpToDate { both, geo_divs, flat_geo_divs };
   std::vector<GeoDiv> geo_divs_;
-
-  // Copy of original data
   std::vector<GeoDiv> geo_divs_original_;
+  FlatGeometry flat_geo_divs_;
+  FlatGeometry flat_geo_divs_original_;
+  UpToDate up_to_date_ = UpToDate::both;
+  UpToDate up_to_date_original_ = UpToDate::both;
 
   // Chosen diagonal for each graticule cell
   boost::multi_array<int, 2> graticule_diagonals_;
 
+  // Diagonal and affine maps for the cell around each of the
+  // (lx_ + 1) * (ly_ + 1) grid points (a, b), i.e. the cell with corners at
+  // x = a - 0.5 and a + 0.5 and at y = b - 0.5 and b + 0.5, cut off at the
+  // edges of the grid. Computed by fill_graticule_diagonals() for proj_ or,
+  // if triangulated_cells_are_original_, for cum_proj_.
+  std::vector<triangulated_cell> triangulated_cells_;
+  bool triangulated_cells_are_original_ = false;
+
   // Variable to store initial inset area before integration
   double initial_area_;
 
   // Map name. Inset position is appended to the name if n_insets > 2.
   std::string inset_name_;
-  std::unordered_map<std::string, bool> is_input_target_area_missing_;
-  std::unordered_map<std::string, std::string> labels_;
   unsigned int lx_{}, ly_{};  // Lattice dimensions
   unsigned int n_finished_integrations_;
   std::string pos_;  // Position of inset ("C", "T" etc.)
@@ -67,11 +123,27 @@ private:
 
   // Rasterized density and its Fourier transform
   FTReal2d rho_ft_, rho_init_;
-  std::unordered_map<std::string, double> target_areas_;
+
+  // Scratch arrays of fill_with_density(), which are reused in every
+  // integration. intersec_with_parallel_to() also uses them, which is why
+  // they are mutable.
+  mutable RasterizerBuffers rasterizer_buffers_;
 
   // Vertical adjacency graph
   std::vector<std::vector<intersection> > vertical_adj_;
 
+  // Flat coordinates of geo_divs_ or, if the argument is true, of
+  // geo_divs_original_. They must be up to date (see sync_flat_geo_divs()).
+  const FlatGeometry &flat_geo_divs(bool = false) const;
+
+  // Return the index of the ID, interning it if it is new
+  unsigned int intern_id(const std::string &);
+
+  // Mutable access to one copy of the coordinates. The other copy is marked
+  // as out of date.
+  FlatGeometry *ref_to_flat_geo_divs(bool = false);
+  std::vector<GeoDiv> *ref_to_geo_divs(bool = false);
+
   // Create cairo surface
   void write_polygons_to_cairo_surface(cairo_t *, bool, bool, bool);
 
@@ -88,7 +160,6 @@ public:
   double area_error_at(const std::string &) const;
   void auto_color();  // Automatically color GeoDivs
   Bbox bbox(bool = false) const;
-  void blur_density(double, bool);
   void check_topology();
   int chosen_diag(const Point v[4], unsigned int &, bool = false) const;
   Color color_at(const std::string &) const;
@@ -97,7 +168,8 @@ public:
   unsigned int colors_size() const;
   void create_contiguity_graph(unsigned int);
   void densify_geo_divs();
-  void densify_geo_divs_using_delaunay_t();
+  void densify_geo_divs_using_delaunay_t(
+    DelaunayLocator = DelaunayLocator::walk);
   void destroy_fftw_plans_for_rho();
   void execute_fftw_bwd_plan() const;
   void execute_fftw_fwd_plan() const;
@@ -105,11 +177,26 @@ public:
   void fill_graticule_diagonals(bool = false);
 
   // Density functions
-  void fill_with_density(bool);  // Fill map with density, using scanlines
-  void flatten_density();  // Flatten said density with integration
-  void flatten_density_with_node_vertices();
+  // Fill map with density
+  void fill_with_density(
+    bool,
+    DensityRasterizer = DensityRasterizer::scanline);
 
-  std::vector<GeoDiv> geo_divs() const;
+  // Blur the density and compute the velocity field for flatten_density()
+  void prepare_velocity_field(double, bool);
+
+  // Flatten said density with integration
+  void flatten_density(const Integrator &);
+  void flatten_density_with_node_vertices(const Integrator &);
+
+  // GeoDivs of the inset or, if the argument is true, the original GeoDivs.
+  // Their coordinates must be up to date (see sync_geo_divs()).
+  const std::vector<GeoDiv> &geo_divs(bool = false) const;
+
+  // ID with the given index and index of an ID that has been read from the
+  // CSV
+  const std::string &id_at(unsigned int) const;
+  unsigned int id_index(const std::string &) const;
   void holes_inside_polygons();
   void increment_integration();
   void initialize_cum_proj();
@@ -118,17 +205,27 @@ public:
   void insert_label(const std::string &, const std::string &);
   void insert_target_area(const std::string &, double);
   void insert_whether_input_target_area_is_missing(const std::string &, bool);
+  std::shared_ptr<IntegrationWorkspace> integration_workspace() const;
   std::string inset_name() const;
   nlohmann::json inset_to_geojson(bool, bool = false) const;
   std::vector<Segment> intersecting_segments(unsigned int) const;
+
+  // Intersections of the GeoDivs with rays parallel to the given axis. There
+  // are `resolution` rays between consecutive graticule lines. The second
+  // version writes the intersections into the given scanlines, whose memory
+  // is reused.
   std::vector<std::vector<intersection> > intersec_with_parallel_to(
     char,
     unsigned int) const;
+  void intersec_with_parallel_to(
+    char,
+    unsigned int,
+    std::vector<std::vector<intersection> > &) const;
   bool is_input_target_area_missing(const std::string &) const;
   std::string label_at(const std::string &) const;
   unsigned int lx() const;
   unsigned int ly() const;
-  void make_fftw_plans_for_rho();
+  void make_fftw_plans_for_rho(unsigned int);
   struct max_area_error_info max_area_error() const;
   unsigned int n_finished_integrations() const;
   unsigned int n_geo_divs() const;
@@ -141,9 +238,10 @@ public:
   Point projected_point(Point, bool = false) const;
   Point projected_point_with_triangulation(Point, bool = false) const;
   void project_with_cum_proj();
-  void project_with_delaunay_t();
+  void project_with_delaunay_t(
+    DelaunayLocator = DelaunayLocator::walk,
+    bool = false);
   void project_with_triangulation();
-  void project_with_proj_sequence();
   void push_back(const GeoDiv &);
 
   // Calculate difference between initial area and current area
@@ -158,9 +256,21 @@ public:
   void set_area_errors();
   void set_grid_dimensions(unsigned int, unsigned int);
   void set_inset_name(const std::string &);
+  void set_integration_workspace(std::shared_ptr<IntegrationWorkspace>);
   void store_initial_area();
   void simplify(unsigned int);
   void store_original_geo_divs();
+
+  // Copy the flat coordinates into the CGAL polygons of the GeoDivs or, if
+  // the argument is true, of the original GeoDivs if they are out of date.
+  // Must be called before the GeoDivs are read after a projection.
+  void sync_geo_divs(bool = false);
+
+  // Copy the coordinates of the GeoDivs into the flat array if it is out of
+  // date and update the areas and bounding boxes of the flat array. Must be
+  // called at the end of every stage that changes the GeoDivs or the flat
+  // points.
+  void sync_flat_geo_divs(bool = false);
   double target_area_at(const std::string &) const;
   bool target_area_is_missing(const std::string &) const;
   double total_inset_area() const;
@@ -169,7 +279,10 @@ public:
     const std::array<Point, 3> &,
     bool = false) const;
 
-  // Apply given function to all points
+  // Apply given function to all points. The template lets the compiler
+  // inline the function. The std::function overload is kept for callers
+  // that choose the function at run time.
+  template <typename F> void transform_points(F, bool = false);
   void transform_points(const std::function<Point(Point)> &, bool = false);
   std::array<Point, 3> untransformed_triangle(Point, bool = false) const;
 
@@ -188,4 +301,28 @@ public:
   void write_polygon_points_on_cairo_surface(cairo_t *, color);
 };
 
+template <typename F>
+void InsetState::transform_points(F transform_point, bool project_original)
+{
+  // Transform the points in the flat array. The array is divided into
+  // chunks of equal size, so that the work is evenly distributed among the
+  // threads even if a few GeoDivs contain most of the points. Each thread
+  // works with its own copy of transform_point.
+  std::vector<XYPoint> &points =
+    *ref_to_flat_geo_divs(project_original)->ref_to_points();
+  const std::size_t n_points = points.size();
+  constexpr std::size_t chunk_size = 4096;
+  const std::size_t n_chunks = (n_points + chunk_size - 1) / chunk_size;
+#pragma omp parallel for default(none) firstprivate(transform_point) \
+  shared(points, n_points, chunk_size, n_chunks) schedule(dynamic)
+  for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    const std::size_t end = std::min(n_points, (chunk + 1) * chunk_size);
+    for (std::size_t k = chunk * chunk_size; k < end; ++k) {
+      const Point p = transform_point(Point(points[k].x, points[k].y));
+      points[k] = XYPoint(p.x(), p.y());
+    }
+  }
+  sync_flat_geo_divs(project_original);
+}
+
 #endif
@@ -0,0 +1,75 @@
+#ifndef INTEGRATION_WORKSPACE_H_
+#define INTEGRATION_WORKSPACE_H_
+
+#include "bilinear_interpolator.h"
+#include "ft_real_2d.h"
+#include "integrator.h"
+#include "xy_point.h"
+#include <cstddef>
+#include <vector>
+
+// Buffers and FFTW plans that are needed in every call of flatten_density()
+// or flatten_density_with_node_vertices(), and the displacement field of
+// project(). They are allocated when the grid dimensions change and reused
+// otherwise, so that successive integrations, and insets with the same grid
+// dimensions, do not allocate memory or make FFTW plans again.
+class IntegrationWorkspace
+{
+private:
+  unsigned int lx_ = 0, ly_ = 0;  // Lattice dimensions
+  unsigned int fftw_planner_flag_;  // Rigor of the FFTW planner
+
+  // Fourier transforms of the flux
+  FTReal2d grid_fluxx_init_;
+  FTReal2d grid_fluxy_init_;
+  VelocityField velocity_field_;
+
+  // Displacement of the graticule points in the current integration
+  BilinearInterpolator displacement_;
+
+  // Positions of the points that are integrated if they are not stored in
+  // a flat array elsewhere (e.g., quadtree corners)
+  std::vector<XYPoint> points_;
+
+  // Scratch arrays for the integrator
+  std::vector<XYPoint> velocities_;
+  std::vector<XYPoint> proposals_;
+  std::vector<XYPoint> proposal_velocities_;
+  std::vector<double> tile_delta_t_;
+  std::vector<IntegrationStats> tile_stats_;
+  std::size_t peak_memory_ = 0;
+
+  void free_flux();
+  void update_peak_memory();
+
+public:
+  explicit IntegrationWorkspace(unsigned int = FFTW_ESTIMATE);
+  ~IntegrationWorkspace();
+
+  // The FFTW plans refer to the buffers of this object. Hence, it must not
+  // be copied.
+  IntegrationWorkspace(const IntegrationWorkspace &) = delete;
+  IntegrationWorkspace &operator=(const IntegrationWorkspace &) = delete;
+
+  FTReal2d *ref_to_grid_fluxx_init();
+  FTReal2d *ref_to_grid_fluxy_init();
+  BilinearInterpolator *ref_to_displacement();
+  VelocityField *ref_to_velocity_field();
+
+  // Return the scratch arrays for integrating n points
+  IntegrationBuffers integration_buffers(std::size_t);
+
+  // Memory currently held by the workspace, and its maximum so far, in
+  // bytes
+  [[nodiscard]] std::size_t memory() const;
+  [[nodiscard]] std::size_t peak_memory() const;
+
+  // Return a flat array for n points
+  std::vector<XYPoint> *ref_to_points(std::size_t);
+
+  // Allocate the flux arrays and make the FFTW plans if the dimensions
+  // differ from those of the previous call
+  void set_grid_dimensions(unsigned int, unsigned int);
+};
+
+#endif
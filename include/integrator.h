@@ -0,0 +1,158 @@
+#ifndef INTEGRATOR_H_
+#define INTEGRATOR_H_
+
+#include "bilinear_interpolator.h"
+#include "xy_point.h"
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// Numerical methods that can be chosen on the command line to integrate the
+// equations of motion in flatten_density()
+enum class IntegrationMethod {
+  midpoint,  // Euler step against explicit midpoint step
+  dormand_prince  // Embedded Runge-Kutta pair of order 5(4)
+};
+
+// Statistics of one integration from t = 0 to t = 1. In multi-rate mode,
+// the steps and rejected steps are those of the tile that needed the most
+// steps.
+struct IntegrationStats {
+  unsigned int n_steps = 0;
+  unsigned int n_rejected_steps = 0;
+
+  // Mean number of times the velocity was evaluated at each point
+  double n_velocity_evaluations = 0.0;
+  double wall_time_ms = 0.0;
+};
+
+// Number of points processed together in one integration step. The
+// intermediate positions and velocities of a tile stay in the L1 cache.
+constexpr std::size_t integration_tile_size = 256;
+
+// Scratch arrays for Integrator::integrate(). The arrays of points have
+// space for at least as many points as are integrated, and the arrays of
+// tiles for at least as many tiles of integration_tile_size points.
+struct IntegrationBuffers {
+  XYPoint *velocities;
+  XYPoint *proposals;
+  XYPoint *proposal_velocities;
+
+  // Step size and statistics of each tile in multi-rate mode
+  double *tile_delta_t;
+  IntegrationStats *tile_stats;
+};
+
+// Common interface of the integrators. Because the velocity field is
+// evaluated lazily, the points are moved independently of each other and can
+// be any set of points inside [0, lx] x [0, ly], for example the graticule
+// points or the quadtree corners.
+class Integrator
+{
+private:
+  bool multi_rate_ = false;
+
+protected:
+  // Move the n points in pts with the velocity field from t_begin to t_end,
+  // using the same step size for all of them. v must contain the velocity
+  // at pts at time t_begin and will contain the velocity at the new
+  // positions at time t_end. next and v_next are scratch arrays of n points
+  // for the proposed positions and their velocities. delta_t is the proposed
+  // size of the next step; it is updated by the step-size control. A step is
+  // rejected unless the squared distance between the two proposals of the
+  // method is at most abs_tol for all points.
+  virtual void advance(
+    const VelocityField &,
+    XYPoint *pts,
+    XYPoint *v,
+    XYPoint *next,
+    XYPoint *v_next,
+    std::size_t n,
+    double t_begin,
+    double t_end,
+    double &delta_t,
+    unsigned int lx,
+    unsigned int ly,
+    double abs_tol,
+    IntegrationStats &,
+    bool print_progress) const = 0;
+
+public:
+  explicit Integrator(bool multi_rate);
+  virtual ~Integrator() = default;
+
+  // Move the n points in pts from t = 0 to t = 1. In multi-rate mode, the
+  // points are split into tiles. Each tile chooses its own step sizes, so
+  // that a single point that needs small steps does not slow down all
+  // other points. The tiles are synchronized at a few fixed times.
+  IntegrationStats integrate(
+    const VelocityField &,
+    XYPoint *pts,
+    std::size_t n,
+    const IntegrationBuffers &,
+    unsigned int lx,
+    unsigned int ly,
+    double abs_tol) const;
+  [[nodiscard]] bool multi_rate() const;
+  [[nodiscard]] virtual std::string_view name() const = 0;
+};
+
+// Explicit midpoint method, with the Euler step as error estimate. The step
+// size is increased by a constant factor after an accepted step and
+// decreased by a constant factor after a rejected step.
+class MidpointIntegrator : public Integrator
+{
+protected:
+  void advance(
+    const VelocityField &,
+    XYPoint *,
+    XYPoint *,
+    XYPoint *,
+    XYPoint *,
+    std::size_t,
+    double,
+    double,
+    double &,
+    unsigned int,
+    unsigned int,
+    double,
+    IntegrationStats &,
+    bool) const override;
+
+public:
+  using Integrator::Integrator;
+  [[nodiscard]] std::string_view name() const override;
+};
+
+// Dormand-Prince 5(4) method with local extrapolation. The step size is
+// adapted in proportion to the error estimate, and the last velocity
+// evaluation of an accepted step is reused as the first one of the next step
+// ("first same as last").
+class DormandPrinceIntegrator : public Integrator
+{
+protected:
+  void advance(
+    const VelocityField &,
+    XYPoint *,
+    XYPoint *,
+    XYPoint *,
+    XYPoint *,
+    std::size_t,
+    double,
+    double,
+    double &,
+    unsigned int,
+    unsigned int,
+    double,
+    IntegrationStats &,
+    bool) const override;
+
+public:
+  using Integrator::Integrator;
+  [[nodiscard]] std::string_view name() const override;
+};
+
+std::unique_ptr<Integrator> make_integrator(IntegrationMethod, bool);
+void print_integration_stats(const Integrator &, const IntegrationStats &);
+
+#endif
@@ -4,19 +4,21 @@
 #include "cgal_typedef.h"
 #include "xy_point.h"
 #include <iostream>
+#include <type_traits>
 
-// Struct to store intersection between line segment and grid line
+// Struct to store intersection between line segment and grid line. Scanlines
+// can hold millions of intersections. Hence, the struct is kept trivially
+// copyable and 16 bytes large. The GeoDiv is identified by its index in
+// InsetState::geo_divs_ rather than by its ID.
 class intersection
 {
 
 private:
   double coord{};  // Coordinate in the direction of the ray
-  bool is_x{};  // Is the direction along the x-axis or y-axis?
 
 public:
-  double target_density{};  // GeoDiv's target_density
-  std::string geo_div_id;  // GeoDIv's ID
-  bool ray_enters{};  // Does the ray enter (true) a GeoDiv or exit (false)?
+  unsigned int geo_div_index : 31 = 0;  // Index of the GeoDiv
+  unsigned int ray_enters : 1 = 0;  // Does the ray enter (1) or exit (0)?
 
   // Overloading "<" operator, similar to above
   bool operator<(const intersection &rhs) const
@@ -26,22 +28,20 @@ public:
       (coord == rhs.coord && ray_enters < rhs.ray_enters));
   }
 
-  // Constructors
-  explicit intersection(bool);
-  intersection();
-
   [[nodiscard]] double x() const;
   [[nodiscard]] double y() const;
-  bool ray_intersects(XYPoint, XYPoint, double, double, double);
+  bool ray_intersects(XYPoint, XYPoint, double, double, bool);
 };
 
+static_assert(sizeof(intersection) == 16);
+static_assert(std::is_trivially_copyable_v<intersection>);
+
 void add_intersections(
   std::vector<intersection> &,
   const Polygon &,
   double,
   double,
-  double,
-  const std::string &,
+  unsigned int,
   char);
 
 #endif
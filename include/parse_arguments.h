@@ -2,6 +2,9 @@
 #define PARSE_ARGUMENTS_H_
 
 #include "argparse.hpp"
+#include "delaunay_locator.h"
+#include "density_rasterizer.h"
+#include "integrator.h"
 #include <iostream>
 
 // Function to parse arguments and set variables in main()
@@ -15,6 +18,13 @@ argparse::ArgumentParser parsed_arguments(
   bool &world,
   bool &triangulation,
   bool &qtdt_method,
+  IntegrationMethod &integration_method,
+  bool &multi_rate,
+  unsigned int &fftw_planner_flag,
+  std::string &fftw_wisdom_file_name,
+  unsigned int &n_threads,
+  DensityRasterizer &density_rasterizer,
+  DelaunayLocator &delaunay_locator,
   bool &simplify,
   bool &make_csv,
   bool &output_equal_area,
@@ -0,0 +1,74 @@
+#ifndef RASTERIZER_BUFFERS_H_
+#define RASTERIZER_BUFFERS_H_
+
+#include "intersection.h"
+#include "xy_point.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Edge of a polygon in the edge table of
+// InsetState::intersec_with_parallel_to(). The edge can only intersect the
+// rays with indices first_ray to last_ray.
+struct scanline_edge {
+  XYPoint curr_point;
+  XYPoint prev_point;
+  unsigned int first_ray;
+  unsigned int last_ray;
+};
+
+// Scratch arrays of one thread in intersec_with_parallel_to()
+struct scanline_thread_buffers {
+  std::vector<scanline_edge> edge_table;
+  std::vector<scanline_edge> sorted_edge_table;
+  std::vector<scanline_edge> active_edges;
+
+  // Position in sorted_edge_table of the first edge that starts at each
+  // ray, for the counting sort of the edge table
+  std::vector<std::size_t> ray_offsets;
+};
+
+// Intersections of one "polygon with holes" with the rays, in ascending
+// order of the ray index. The first element of each pair is the ray index.
+typedef std::vector<std::pair<unsigned int, intersection> > pwh_intersections;
+
+// Area of a GeoDiv inside each grid cell of its bounding box
+struct geo_div_coverage {
+  int x_begin = 0, y_begin = 0;  // First cell of the bounding box
+  unsigned int n_cols = 0, n_rows = 0;
+  std::vector<double> area;
+};
+
+// Arrays that InsetState::fill_with_density() needs in every integration.
+// They are kept between integrations, so that memory is only allocated if
+// the map needs more than in all previous integrations (e.g., because the
+// polygons cross more rays). The arrays of each thread are reserved for the
+// largest polygon or GeoDiv, so that it does not matter which thread
+// processes which polygon.
+struct RasterizerBuffers {
+
+  // Target density and area error of each GeoDiv, indexed like geo_divs_
+  std::vector<double> target_densities;
+  std::vector<double> area_errors;
+
+  // Arrays of intersec_with_parallel_to()
+  std::vector<unsigned int> pwh_geo_divs;
+  std::vector<pwh_intersections> intersections;
+  std::vector<std::size_t> n_intersections;
+  std::vector<scanline_thread_buffers> scanline_threads;
+
+  // Intersections with the sampling rays and, in adaptive mode, with one
+  // ray through the middle of each row of the grid
+  std::vector<std::vector<intersection> > scanlines;
+  std::vector<std::vector<intersection> > coarse_scanlines;
+
+  // Cells crossed by a boundary in adaptive mode and the next such cell in
+  // each row
+  std::vector<char> is_boundary;
+  std::vector<unsigned int> next_sampled_cell;
+
+  // Coverage of the current GeoDiv of each thread in exact mode
+  std::vector<geo_div_coverage> coverages;
+};
+
+#endif
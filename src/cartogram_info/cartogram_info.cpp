@@ -65,8 +65,9 @@ void CartogramInfo::replace_missing_and_zero_target_areas()
   // Get total current area and total target area
   double total_start_area_with_data = 0.0;
   double total_target_area_with_data = 0.0;
-  for (const auto &inset_info : inset_states_) {
+  for (auto &inset_info : inset_states_) {
     auto &inset_state = inset_info.second;
+    inset_state.sync_geo_divs();
     for (const auto &gd : inset_state.geo_divs()) {
       if (!inset_state.target_area_is_missing(gd.id())) {
         total_start_area_with_data += gd.area();
@@ -56,10 +56,11 @@ void check_geojson_validity(const nlohmann::json &j)
 
 std::pair<GeoDiv, bool> json_to_geodiv(
   const std::string &id,
+  const unsigned int id_index,
   const nlohmann::json &json_coords_raw,
   const bool is_polygon)
 {
-  GeoDiv gd(id);
+  GeoDiv gd(id, id_index);
   nlohmann::json json_coords;
   if (is_polygon) {
     json_coords["0"] = json_coords_raw;
@@ -240,13 +241,20 @@ void CartogramInfo::read_geojson(
             _Exit(18);
           }
           ids_in_geojson.insert(id);
-          const auto gd_and_orientation =
-            json_to_geodiv(id, geometry["coordinates"], is_polygon);
+          const auto gd_and_orientation = json_to_geodiv(
+            id,
+            inset_state.id_index(id),
+            geometry["coordinates"],
+            is_polygon);
           inset_state.push_back(gd_and_orientation.first);
           original_ext_ring_is_clockwise_ = gd_and_orientation.second;
         }
       }
     }
+
+    // Copy the coordinates into the flat array, from which the bounding box
+    // and the areas are computed
+    inset_state.sync_flat_geo_divs();
   }
 
   // Create a CSV from the given GeoJSON file
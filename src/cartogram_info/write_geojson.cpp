@@ -29,7 +29,8 @@ nlohmann::json CartogramInfo::cgal_to_json(
   nlohmann::json container = nlohmann::json::array();
 
   // Insert each inset into `container`
-  for (const auto &[inset_pos, inset_state] : inset_states_) {
+  for (auto &[inset_pos, inset_state] : inset_states_) {
+    inset_state.sync_geo_divs(original_geo_divs_to_geojson);
     const nlohmann::json inset_container = inset_state.inset_to_geojson(
       original_ext_ring_is_clockwise_,
       original_geo_divs_to_geojson);
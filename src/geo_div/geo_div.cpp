@@ -5,9 +5,12 @@
 
 GeoDiv::GeoDiv() = default;
 
-GeoDiv::GeoDiv(std::string i) : id_(std::move(i)) {}
+GeoDiv::GeoDiv(std::string i, const unsigned int id_index)
+    : id_(std::move(i)), id_index_(id_index)
+{
+}
 
-std::set<std::string> GeoDiv::adjacent_geodivs() const
+const std::set<std::string> &GeoDiv::adjacent_geodivs() const
 {
   return adjacent_geodivs_;
 }
@@ -19,22 +22,44 @@ void GeoDiv::adjacent_to(const std::string &id)
 
 double GeoDiv::area() const
 {
+  if (area_and_bbox_are_current_) {
+    return area_;
+  }
   double a = 0.0;
-  for (const auto &pwh : polygons_with_holes()) {
+  for (const auto &pwh : polygons_with_holes_) {
     a += pwh_area(pwh);
   }
   return a;
 }
 
-std::string GeoDiv::id() const
+Bbox GeoDiv::bbox() const
+{
+  if (area_and_bbox_are_current_) {
+    return bbox_;
+  }
+  Bbox bb;
+  for (const auto &pwh : polygons_with_holes_) {
+    bb += pwh.outer_boundary().bbox();
+  }
+  return bb;
+}
+
+const std::string &GeoDiv::id() const
 {
   return id_;
 }
 
-Polygon_with_holes GeoDiv::largest_polygon_with_holes() const
+unsigned int GeoDiv::id_index() const
+{
+  return id_index_;
+}
+
+const Polygon_with_holes &GeoDiv::largest_polygon_with_holes() const
 {
+  // Returned if the GeoDiv has no polygons
+  static const Polygon_with_holes empty_pwh;
   double max_area = -dbl_inf;
-  Polygon_with_holes largest_pwh;
+  const Polygon_with_holes *largest_pwh = &empty_pwh;
   for (const auto &pwh : polygons_with_holes_) {
     double area = 0.0;
     const auto &ext_ring = pwh.outer_boundary();
@@ -44,10 +69,10 @@ Polygon_with_holes GeoDiv::largest_polygon_with_holes() const
     }
     if (area > max_area) {
       max_area = area;
-      largest_pwh = Polygon_with_holes(pwh);
+      largest_pwh = &pwh;
     }
   }
-  return largest_pwh;
+  return *largest_pwh;
 }
 
 unsigned int GeoDiv::n_points() const
@@ -91,56 +116,41 @@ Point GeoDiv::point_on_surface_of_polygon_with_holes(
   const double line_y = 0.5 * (bb.ymin() + bb.ymax());
   const double epsilon = 1e-6;
 
-  // Vector to store intersections
+  // Vector to store intersections. All intersections belong to this GeoDiv.
   std::vector<intersection> intersections;
   add_intersections(
     intersections,
     pwh.outer_boundary(),
     line_y,
-    0,
     epsilon,
-    id_,
+    0,
     'x');
 
   // Store hole intersections
   for (auto hci = pwh.holes_begin(); hci != pwh.holes_end(); ++hci) {
-    add_intersections(intersections, *hci, line_y, 0, epsilon, id_, 'x');
+    add_intersections(intersections, *hci, line_y, epsilon, 0, 'x');
   }
   std::sort(intersections.begin(), intersections.end());
 
-  // Assign directions (i.e., whether the line is entering or leaving the
-  // polygon with holes)
-  for (unsigned int i = 0; i < intersections.size(); ++i) {
-    intersections[i].ray_enters = (i % 2 == 0);
-  }
-
-  // TODO: Using target_density when we really mean line length feels like a
-  //       bad hack. should we rename the data member target_density to
-  //       value_in_geo_div?
-  // Assign length of line segments using the target_density property of
-  // intersections for line segment lengths
-  for (unsigned int i = 0; i < intersections.size(); i += 2) {
-    intersections[i].target_density =
-      intersections[i + 1].x() - intersections[i].x();
-  }
-
-  // Find midpoint in maximum segment length
+  // Find midpoint in maximum segment length. Consecutive pairs of sorted
+  // intersections enclose the parts of the line inside the polygon with
+  // holes.
   double max_length = 0.0;
   double mid_x = -1.0;  // Temporary value
 
   // Iterate over lengths
-  for (unsigned int i = 0; i < intersections.size(); i += 2) {
-    if (intersections[i].target_density > max_length) {
-      const double left = intersections[i].x();
-      const double right = intersections[i + 1].x();
-      max_length = intersections[i].target_density;
+  for (unsigned int i = 0; i + 1 < intersections.size(); i += 2) {
+    const double left = intersections[i].x();
+    const double right = intersections[i + 1].x();
+    if (right - left > max_length) {
+      max_length = right - left;
       mid_x = (right + left) / 2;
     }
   }
   return {mid_x, line_y};
 }
 
-std::vector<Polygon_with_holes> GeoDiv::polygons_with_holes() const
+const std::vector<Polygon_with_holes> &GeoDiv::polygons_with_holes() const
 {
   return polygons_with_holes_;
 }
@@ -148,13 +158,22 @@ std::vector<Polygon_with_holes> GeoDiv::polygons_with_holes() const
 void GeoDiv::push_back(const Polygon_with_holes &pwh)
 {
   polygons_with_holes_.push_back(pwh);
+  area_and_bbox_are_current_ = false;
 }
 
 std::vector<Polygon_with_holes> *GeoDiv::ref_to_polygons_with_holes()
 {
+  area_and_bbox_are_current_ = false;
   return &polygons_with_holes_;
 }
 
+void GeoDiv::set_area_and_bbox(const double area, const Bbox bbox)
+{
+  area_ = area;
+  bbox_ = bbox;
+  area_and_bbox_are_current_ = true;
+}
+
 void GeoDiv::sort_pwh_descending_by_area()
 {
   std::sort(
@@ -162,3 +181,32 @@ void GeoDiv::sort_pwh_descending_by_area()
     polygons_with_holes_.end(),
     pwh_is_larger);
 }
+
+void GeoDiv::update_area_and_bbox()
+{
+  // Twice the signed area of a ring by the shoelace formula
+  const auto twice_ring_area = [](const Polygon &ring) {
+    double a = 0.0;
+    for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+      a += (ring[j].x() - ring[i].x()) * (ring[j].y() + ring[i].y());
+    }
+    return a;
+  };
+  area_ = 0.0;
+  bbox_ = Bbox();
+  for (const auto &pwh : polygons_with_holes_) {
+    const auto &ext_ring = pwh.outer_boundary();
+    area_ += twice_ring_area(ext_ring);
+
+    // The holes lie inside the exterior ring. Hence, they do not change the
+    // bounding box.
+    for (const auto &p : ext_ring) {
+      bbox_ += p.bbox();
+    }
+    for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+      area_ += twice_ring_area(*h);
+    }
+  }
+  area_ /= 2;
+  area_and_bbox_are_current_ = true;
+}
@@ -20,11 +20,13 @@ void print_albers_bbox(Bbox bb)
 
 void InsetState::adjust_for_dual_hemisphere()
 {
+  sync_geo_divs();
+
   // Determine the maximum longitude in the western hemisphere and the minimum
   // longitude in the eastern hemisphere
   double max_lon_west = -dbl_inf;
   double min_lon_east = dbl_inf;
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto bb = pwh.bbox();
       const double xmax = bb.xmax();
@@ -50,7 +52,7 @@ void InsetState::adjust_for_dual_hemisphere()
       min_lon_east - max_lon_west >= 180) {
 
     // Iterate over GeoDivs
-    for (auto &gd : geo_divs_) {
+    for (auto &gd : *ref_to_geo_divs()) {
 
       // Iterate over Polygon_with_holes
       for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
@@ -66,6 +68,7 @@ void InsetState::adjust_for_dual_hemisphere()
           }
         }
       }
+      gd.update_area_and_bbox();
     }
   }
   return;
@@ -129,10 +132,9 @@ void InsetState::apply_albers_projection()
 
   // Specialize/curry point_after_albers_projection() s0 that it only requires
   // one argument (Point p1).
-  std::function<Point(Point)> lambda =
-    [=](Point p1) {
-      return point_after_albers_projection(p1, lambda_0, phi_0, phi_1, phi_2);
-    };
+  const auto lambda = [=](Point p1) {
+    return point_after_albers_projection(p1, lambda_0, phi_0, phi_1, phi_2);
+  };
 
   // Apply `lambda` to all points
   transform_points(lambda);
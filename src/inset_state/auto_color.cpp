@@ -33,7 +33,7 @@ void InsetState::auto_color()
   int max_i = palette.size();
 
   // Iterate until we are able to color the entire map
-  while (colors_.size() < n_geo_divs() && max_i >= 0) {
+  while (n_colors_ < n_geo_divs() && max_i >= 0) {
     for (const auto &gd : geo_divs_) {
 
       // Iterate over all possible colors
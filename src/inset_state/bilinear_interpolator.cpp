@@ -0,0 +1,363 @@
+#include "bilinear_interpolator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+// On x86-64, the interpolation kernels are compiled for AVX-512, AVX2 and the
+// baseline instruction set, and the best version that the CPU supports is
+// chosen at run time. Elsewhere, the kernels are compiled only once and left
+// to the compiler's auto-vectorization for the target architecture.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_X86_KERNELS
+#endif
+
+// Interpolate n points on the padded lattice. The arithmetic is the same as
+// in interpolate_bilinearly(), including the order of the terms in the final
+// sum, so that both functions return identical results.
+// tests/test_bilinear_interpolator.cpp checks this for every instruction set.
+static inline __attribute__((always_inline)) void interpolate_block(
+  const double *__restrict nodes,
+  const unsigned int lx,
+  const unsigned int ly,
+  const XYPoint *__restrict pts,
+  XYPoint *__restrict out,
+  const std::size_t n)
+{
+  const double dlx = lx;
+  const double dly = ly;
+  const int row_stride = 2 * static_cast<int>(ly + 2);
+
+#pragma omp simd
+  for (std::size_t k = 0; k < n; ++k) {
+    const double x = pts[k].x;
+    const double y = pts[k].y;
+
+    // Index of the padded node at or below x (or y). Clamping only matters
+    // for points outside [0, lx] x [0, ly], which the caller must not pass.
+    // It keeps the memory access in bounds nevertheless.
+    const double a = std::min(std::max(std::floor(x + 0.5), 0.0), dlx);
+    const double b = std::min(std::max(std::floor(y + 0.5), 0.0), dly);
+
+    // Coordinates of the surrounding nodes. The spacing is 0.5 instead of 1
+    // between the boundary and the first interior node.
+    const double x0 = std::max(0.0, a - 0.5);
+    const double x1 = std::min(dlx, a + 0.5);
+    const double y0 = std::max(0.0, b - 0.5);
+    const double y1 = std::min(dly, b + 0.5);
+    const double delta_x = (x - x0) / (x1 - x0);
+    const double delta_y = (y - y0) / (y1 - y0);
+
+    const int n00 = static_cast<int>(a) * row_stride + 2 * static_cast<int>(b);
+    const int n10 = n00 + row_stride;
+    out[k].x = (1.0 - delta_x) * (1.0 - delta_y) * nodes[n00] +
+               (1.0 - delta_x) * delta_y * nodes[n00 + 2] +
+               delta_x * (1.0 - delta_y) * nodes[n10] +
+               delta_x * delta_y * nodes[n10 + 2];
+    out[k].y = (1.0 - delta_x) * (1.0 - delta_y) * nodes[n00 + 1] +
+               (1.0 - delta_x) * delta_y * nodes[n00 + 3] +
+               delta_x * (1.0 - delta_y) * nodes[n10 + 1] +
+               delta_x * delta_y * nodes[n10 + 3];
+  }
+}
+
+// Evaluate the velocity field at time t at n points. The node indices and
+// weights are computed as in interpolate_block(). The velocity at each of
+// the four surrounding nodes is computed with the same arithmetic as the
+// full-grid velocity in earlier versions of flatten_density().
+static inline __attribute__((always_inline)) void velocity_block(
+  const double *__restrict nodes,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double t,
+  const double rho_ft_00,
+  const XYPoint *__restrict pts,
+  XYPoint *__restrict out,
+  const std::size_t n)
+{
+  const double dlx = lx;
+  const double dly = ly;
+  const int row_stride = 3 * static_cast<int>(ly + 2);
+
+#pragma omp simd
+  for (std::size_t k = 0; k < n; ++k) {
+    const double x = pts[k].x;
+    const double y = pts[k].y;
+    const double a = std::min(std::max(std::floor(x + 0.5), 0.0), dlx);
+    const double b = std::min(std::max(std::floor(y + 0.5), 0.0), dly);
+    const double x0 = std::max(0.0, a - 0.5);
+    const double x1 = std::min(dlx, a + 0.5);
+    const double y0 = std::max(0.0, b - 0.5);
+    const double y1 = std::min(dly, b + 0.5);
+    const double delta_x = (x - x0) / (x1 - x0);
+    const double delta_y = (y - y0) / (y1 - y0);
+
+    const int n00 = static_cast<int>(a) * row_stride + 3 * static_cast<int>(b);
+    const int n01 = n00 + 3;
+    const int n10 = n00 + row_stride;
+    const int n11 = n10 + 3;
+    const double rho00 = rho_ft_00 + (1.0 - t) * (nodes[n00 + 2] - rho_ft_00);
+    const double rho01 = rho_ft_00 + (1.0 - t) * (nodes[n01 + 2] - rho_ft_00);
+    const double rho10 = rho_ft_00 + (1.0 - t) * (nodes[n10 + 2] - rho_ft_00);
+    const double rho11 = rho_ft_00 + (1.0 - t) * (nodes[n11 + 2] - rho_ft_00);
+    out[k].x = (1.0 - delta_x) * (1.0 - delta_y) * (-nodes[n00] / rho00) +
+               (1.0 - delta_x) * delta_y * (-nodes[n01] / rho01) +
+               delta_x * (1.0 - delta_y) * (-nodes[n10] / rho10) +
+               delta_x * delta_y * (-nodes[n11] / rho11);
+    out[k].y = (1.0 - delta_x) * (1.0 - delta_y) * (-nodes[n00 + 1] / rho00) +
+               (1.0 - delta_x) * delta_y * (-nodes[n01 + 1] / rho01) +
+               delta_x * (1.0 - delta_y) * (-nodes[n10 + 1] / rho10) +
+               delta_x * delta_y * (-nodes[n11 + 1] / rho11);
+  }
+}
+
+// Versions of the kernels for one instruction set
+struct interpolation_kernels {
+  void (*interpolate)(
+    const double *,
+    unsigned int,
+    unsigned int,
+    const XYPoint *,
+    XYPoint *,
+    std::size_t);
+  void (*velocity)(
+    const double *,
+    unsigned int,
+    unsigned int,
+    double,
+    double,
+    const XYPoint *,
+    XYPoint *,
+    std::size_t);
+};
+
+// Compile both kernels with the given function attribute. The kernels are
+// inlined, so that their loops are vectorized for the attribute's
+// instruction set.
+#define DEFINE_INTERPOLATION_KERNELS(name, attribute)                     \
+  attribute static void interpolate_block_##name(                         \
+    const double *__restrict nodes,                                       \
+    const unsigned int lx,                                                \
+    const unsigned int ly,                                                \
+    const XYPoint *__restrict pts,                                        \
+    XYPoint *__restrict out,                                              \
+    const std::size_t n)                                                  \
+  {                                                                       \
+    interpolate_block(nodes, lx, ly, pts, out, n);                        \
+  }                                                                       \
+  attribute static void velocity_block_##name(                            \
+    const double *__restrict nodes,                                       \
+    const unsigned int lx,                                                \
+    const unsigned int ly,                                                \
+    const double t,                                                       \
+    const double rho_ft_00,                                               \
+    const XYPoint *__restrict pts,                                        \
+    XYPoint *__restrict out,                                              \
+    const std::size_t n)                                                  \
+  {                                                                       \
+    velocity_block(nodes, lx, ly, t, rho_ft_00, pts, out, n);             \
+  }                                                                       \
+  static constexpr interpolation_kernels name##_kernels = {               \
+    interpolate_block_##name,                                             \
+    velocity_block_##name};
+
+DEFINE_INTERPOLATION_KERNELS(baseline, )
+#ifdef HAVE_X86_KERNELS
+DEFINE_INTERPOLATION_KERNELS(avx2, __attribute__((target("avx2"))))
+DEFINE_INTERPOLATION_KERNELS(avx512f, __attribute__((target("avx512f"))))
+#endif
+
+static bool is_supported(const InstructionSet instruction_set)
+{
+  switch (instruction_set) {
+  case InstructionSet::baseline:
+    return true;
+#ifdef HAVE_X86_KERNELS
+  case InstructionSet::avx2:
+    return __builtin_cpu_supports("avx2");
+  case InstructionSet::avx512f:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+// Instruction set of the kernels that are currently used. Initially, it is
+// the best one that the CPU supports.
+static std::atomic<InstructionSet> &active_instruction_set()
+{
+  static std::atomic<InstructionSet> instruction_set(
+    supported_instruction_sets().back());
+  return instruction_set;
+}
+
+static const interpolation_kernels &active_kernels()
+{
+  switch (active_instruction_set().load(std::memory_order_relaxed)) {
+#ifdef HAVE_X86_KERNELS
+  case InstructionSet::avx2:
+    return avx2_kernels;
+  case InstructionSet::avx512f:
+    return avx512f_kernels;
+#endif
+  default:
+    return baseline_kernels;
+  }
+}
+
+std::vector<InstructionSet> supported_instruction_sets()
+{
+  std::vector<InstructionSet> instruction_sets;
+  for (const auto instruction_set :
+       {InstructionSet::baseline,
+        InstructionSet::avx2,
+        InstructionSet::avx512f}) {
+    if (is_supported(instruction_set)) {
+      instruction_sets.push_back(instruction_set);
+    }
+  }
+  return instruction_sets;
+}
+
+void use_instruction_set(const InstructionSet instruction_set)
+{
+  if (!is_supported(instruction_set)) {
+    std::cerr << "ERROR: Instruction set not supported in " << __func__
+              << "()." << std::endl;
+    exit(1);
+  }
+  active_instruction_set().store(instruction_set);
+}
+
+BilinearInterpolator::BilinearInterpolator(
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  set_grid_dimensions(lx, ly);
+}
+
+XYPoint BilinearInterpolator::interpolate(const double x, const double y) const
+{
+  const XYPoint pt(x, y);
+  XYPoint result;
+  active_kernels().interpolate(nodes_.data(), lx_, ly_, &pt, &result, 1);
+  return result;
+}
+
+void BilinearInterpolator::interpolate(
+  const XYPoint *pts,
+  XYPoint *out,
+  const std::size_t n) const
+{
+  active_kernels().interpolate(nodes_.data(), lx_, ly_, pts, out, n);
+}
+
+std::size_t BilinearInterpolator::memory() const
+{
+  return nodes_.capacity() * sizeof(double);
+}
+
+void BilinearInterpolator::pad_boundaries()
+{
+  // gx is continued to y = 0 and y = ly, gy to x = 0 and x = lx
+  for (unsigned int a = 1; a <= lx_; ++a) {
+    nodes_[node_index(a, 0)] = nodes_[node_index(a, 1)];
+    nodes_[node_index(a, ly_ + 1)] = nodes_[node_index(a, ly_)];
+    nodes_[node_index(a, 0) + 1] = 0.0;
+    nodes_[node_index(a, ly_ + 1) + 1] = 0.0;
+  }
+  for (unsigned int b = 1; b <= ly_; ++b) {
+    nodes_[node_index(0, b)] = 0.0;
+    nodes_[node_index(lx_ + 1, b)] = 0.0;
+    nodes_[node_index(0, b) + 1] = nodes_[node_index(1, b) + 1];
+    nodes_[node_index(lx_ + 1, b) + 1] = nodes_[node_index(lx_, b) + 1];
+  }
+
+  // Both grids vanish at the four corners
+  for (const unsigned int a : {0U, lx_ + 1}) {
+    for (const unsigned int b : {0U, ly_ + 1}) {
+      nodes_[node_index(a, b)] = 0.0;
+      nodes_[node_index(a, b) + 1] = 0.0;
+    }
+  }
+}
+
+void BilinearInterpolator::set_grid_dimensions(
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  lx_ = lx;
+  ly_ = ly;
+  nodes_.assign(2 * static_cast<std::size_t>(lx + 2) * (ly + 2), 0.0);
+}
+
+VelocityField::VelocityField(const unsigned int lx, const unsigned int ly)
+{
+  set_grid_dimensions(lx, ly);
+}
+
+std::size_t VelocityField::memory() const
+{
+  return nodes_.capacity() * sizeof(double);
+}
+
+void VelocityField::pad_boundaries()
+{
+  // fluxx vanishes at x = 0 and x = lx, fluxy at y = 0 and y = ly.
+  // Otherwise, the values at the nearest interior node are continued to the
+  // edge. The density is continued everywhere, including the corners, so
+  // that it never vanishes.
+  for (unsigned int a = 1; a <= lx_; ++a) {
+    for (const auto &[pad, interior] : {std::pair{0U, 1U}, {ly_ + 1, ly_}}) {
+      nodes_[node_index(a, pad)] = nodes_[node_index(a, interior)];
+      nodes_[node_index(a, pad) + 1] = 0.0;
+      nodes_[node_index(a, pad) + 2] = nodes_[node_index(a, interior) + 2];
+    }
+  }
+  for (unsigned int b = 0; b <= ly_ + 1; ++b) {
+    for (const auto &[pad, interior] : {std::pair{0U, 1U}, {lx_ + 1, lx_}}) {
+      nodes_[node_index(pad, b)] = 0.0;
+      nodes_[node_index(pad, b) + 1] =
+        (b == 0 || b == ly_ + 1) ? 0.0 : nodes_[node_index(interior, b) + 1];
+      nodes_[node_index(pad, b) + 2] = nodes_[node_index(interior, b) + 2];
+    }
+  }
+}
+
+void VelocityField::set_grid_dimensions(
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  lx_ = lx;
+  ly_ = ly;
+  nodes_.assign(3 * static_cast<std::size_t>(lx + 2) * (ly + 2), 0.0);
+}
+
+void VelocityField::set_rho_ft_00(const double rho_ft_00)
+{
+  rho_ft_00_ = rho_ft_00;
+}
+
+XYPoint VelocityField::velocity(
+  const double t,
+  const double x,
+  const double y) const
+{
+  const XYPoint pt(x, y);
+  XYPoint result;
+  active_kernels()
+    .velocity(nodes_.data(), lx_, ly_, t, rho_ft_00_, &pt, &result, 1);
+  return result;
+}
+
+void VelocityField::velocity(
+  const double t,
+  const XYPoint *pts,
+  XYPoint *out,
+  const std::size_t n) const
+{
+  active_kernels()
+    .velocity(nodes_.data(), lx_, ly_, t, rho_ft_00_, pts, out, n);
+}
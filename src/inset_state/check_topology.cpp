@@ -5,7 +5,7 @@
 // Returns error if there are holes not inside their respective polygons
 void InsetState::holes_inside_polygons()
 {
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto ext_ring = pwh.outer_boundary();
       for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
@@ -50,7 +50,7 @@ bool duplicates(std::vector<Point> v) {
 
 void InsetState::rings_are_simple()
 {
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto ext_ring = pwh.outer_boundary();
       if (!ext_ring.is_simple()) {
@@ -74,6 +74,7 @@ void InsetState::rings_are_simple()
 
 void InsetState::check_topology()
 {
+  sync_geo_divs();
   holes_inside_polygons();
   rings_are_simple();
 }
@@ -1,6 +1,7 @@
 #include "inset_state.h"
 #include "round_point.h"
 #include <CGAL/intersections.h>
+#include <utility>
 
 // For printing a vector (debugging purposes)
 template <typename A>
@@ -216,9 +217,11 @@ std::vector<Point> densification_points(
 void InsetState::densify_geo_divs()
 {
   std::cerr << "Densifying" << std::endl;
+  std::vector<GeoDiv> &geo_divs = *ref_to_geo_divs();
   std::vector<GeoDiv> geodivs_dens;
-  for (const auto &gd : geo_divs_) {
-    GeoDiv gd_dens(gd.id());
+  geodivs_dens.reserve(geo_divs.size());
+  for (const auto &gd : geo_divs) {
+    GeoDiv gd_dens(gd.id(), gd.id_index());
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto outer = pwh.outer_boundary();
       Polygon outer_dens;
@@ -268,18 +271,33 @@ void InsetState::densify_geo_divs()
         holes_v_dens.end());
       gd_dens.push_back(pwh_dens);
     }
-    geodivs_dens.push_back(gd_dens);
+    gd_dens.update_area_and_bbox();
+    geodivs_dens.push_back(std::move(gd_dens));
   }
-  geo_divs_.clear();
-  geo_divs_ = geodivs_dens;
+  geo_divs = std::move(geodivs_dens);
+
+  // Copy the new points into the flat array now. Densification adds points
+  // in every integration, so the array may need more memory. The following
+  // stages then work on memory that has already been allocated.
+  sync_flat_geo_divs();
 }
 
+// The faces that contain pt1 and pt2 are found with located_face(). Unless
+// delaunay_locator is DelaunayLocator::cold, the search for pt1 starts from
+// the face hint, and the search for pt2 from the face of pt1. Afterwards,
+// hint is the face of pt2, which is where the next segment on the ring
+// starts. The number of located points and the number of steps of the
+// searches are added to n_locates and n_steps.
 std::vector<Point> densification_points_with_delaunay_t(
   const Point &pt1,
   const Point &pt2,
   const Delaunay &dt,
   const unsigned int lx,
-  const unsigned int ly)
+  const unsigned int ly,
+  const DelaunayLocator delaunay_locator,
+  Face_handle &hint,
+  unsigned long &n_locates,
+  unsigned long &n_steps)
 {
   std::vector<Point> dens_points;
 
@@ -292,8 +310,13 @@ std::vector<Point> densification_points_with_delaunay_t(
     return {pt1, pt2};
   }
 
-  Face_handle f1 = dt.locate(pt1);
-  Face_handle f2 = dt.locate(pt2);
+  const bool use_hint = (delaunay_locator != DelaunayLocator::cold);
+  Face_handle f1 =
+    located_face(dt, pt1, use_hint ? hint : Face_handle(), n_steps);
+  Face_handle f2 =
+    located_face(dt, pt2, use_hint ? f1 : Face_handle(), n_steps);
+  hint = f2;
+  n_locates += 2;
 
   // If they are inside the same triangle then return original points
   if (f1 == f2) {
@@ -398,12 +421,18 @@ std::vector<Point> densification_points_with_delaunay_t(
   return dens_points;
 }
 
-void InsetState::densify_geo_divs_using_delaunay_t()
+void InsetState::densify_geo_divs_using_delaunay_t(
+  const DelaunayLocator delaunay_locator)
 {
   std::cerr << "Densifying using Delaunay Triangulation" << std::endl;
+  Face_handle hint;
+  unsigned long n_locates = 0;
+  unsigned long n_steps = 0;
+  std::vector<GeoDiv> &geo_divs = *ref_to_geo_divs();
   std::vector<GeoDiv> geodivs_dens;
-  for (const auto &gd : geo_divs_) {
-    GeoDiv gd_dens(gd.id());
+  geodivs_dens.reserve(geo_divs.size());
+  for (const auto &gd : geo_divs) {
+    GeoDiv gd_dens(gd.id(), gd.id_index());
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto outer = pwh.outer_boundary();
       Polygon outer_dens;
@@ -419,7 +448,16 @@ void InsetState::densify_geo_divs_using_delaunay_t()
         const auto b = (i == outer.size() - 1) ? outer[0] : outer[i + 1];
         // Densify the segment
         const std::vector<Point> outer_pts_dens =
-          densification_points_with_delaunay_t(a, b, proj_qd_.dt, lx_, ly_);
+          densification_points_with_delaunay_t(
+            a,
+            b,
+            proj_qd_.dt,
+            lx_,
+            ly_,
+            delaunay_locator,
+            hint,
+            n_locates,
+            n_steps);
 
         // Push all points. Omit the last point because it will be included
         // in the next iteration. Otherwise, we would have duplicated points
@@ -439,7 +477,16 @@ void InsetState::densify_geo_divs_using_delaunay_t()
           const Point c = (*h)[j];
           const Point d = (j == h->size() - 1) ? (*h)[0] : (*h)[j + 1];
           const std::vector<Point> hole_pts_dens =
-            densification_points_with_delaunay_t(c, d, proj_qd_.dt, lx_, ly_);
+            densification_points_with_delaunay_t(
+              c,
+              d,
+              proj_qd_.dt,
+              lx_,
+              ly_,
+              delaunay_locator,
+              hint,
+              n_locates,
+              n_steps);
           for (unsigned int i = 0; i < (hole_pts_dens.size() - 1); ++i) {
             hole_dens.push_back(hole_pts_dens[i]);
           }
@@ -452,8 +499,14 @@ void InsetState::densify_geo_divs_using_delaunay_t()
         holes_v_dens.end());
       gd_dens.push_back(pwh_dens);
     }
-    geodivs_dens.push_back(gd_dens);
+    gd_dens.update_area_and_bbox();
+    geodivs_dens.push_back(std::move(gd_dens));
+  }
+  geo_divs = std::move(geodivs_dens);
+  sync_flat_geo_divs();  // See densify_geo_divs()
+  if (n_locates > 0) {
+    std::cerr << "Delaunay point location for densification: "
+              << static_cast<double>(n_steps) / n_locates
+              << " steps per point" << std::endl;
   }
-  geo_divs_.clear();
-  geo_divs_ = geodivs_dens;
 }
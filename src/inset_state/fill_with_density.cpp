@@ -1,7 +1,291 @@
 #include "cartogram_info.h"
 #include "inset_state.h"
+#include <omp.h>
 
-void InsetState::fill_with_density(bool plot_density)
+// Function to add the signed area between the edge from p0 to p1 and the
+// left boundary of the grid to the cells in acc, as in the accumulation
+// method of font rasterizers. acc has n_rows rows of n_cols cells. After
+// all edges of counterclockwise rings are added, minus the prefix sum along
+// a row is the exact area inside each cell of that row. Clockwise rings
+// (i.e., holes) are subtracted. The x-coordinates must lie in
+// [0, n_cols - 2].
+static void accumulate_edge_coverage(
+  XYPoint p0,
+  XYPoint p1,
+  const unsigned int n_cols,
+  const unsigned int n_rows,
+  std::vector<double> &acc)
+{
+  if (p0.y == p1.y) {
+    return;
+  }
+  double dir = 1.0;
+  if (p0.y > p1.y) {
+    std::swap(p0, p1);
+    dir = -1.0;
+  }
+  const double dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+  double x = p0.x;
+  if (p0.y < 0.0) {
+    x -= p0.y * dxdy;
+  }
+  const auto y_begin =
+    static_cast<unsigned int>(std::max(0.0, std::floor(p0.y)));
+  const auto y_end = static_cast<unsigned int>(
+    std::min(static_cast<double>(n_rows), std::ceil(p1.y)));
+  for (unsigned int y = y_begin; y < y_end; ++y) {
+    double *row = &acc[static_cast<std::size_t>(y) * n_cols];
+
+    // Part of the edge inside row y, from (x, ...) to (x_next, ...)
+    const double dy =
+      std::min(y + 1.0, p1.y) - std::max(static_cast<double>(y), p0.y);
+    const double x_next = x + dxdy * dy;
+    const double d = dy * dir;
+    const double x0 = std::min(x, x_next);
+    const double x1 = std::max(x, x_next);
+    const double x0_floor = std::floor(x0);
+    const double x1_ceil = std::ceil(x1);
+    const auto x0i = static_cast<unsigned int>(x0_floor);
+    const auto x1i = static_cast<unsigned int>(x1_ceil);
+    if (x1i <= x0i + 1) {
+
+      // The part of the edge is inside a single cell
+      const double xmf = 0.5 * (x + x_next) - x0_floor;
+      row[x0i] += d - d * xmf;
+      row[x0i + 1] += d * xmf;
+    } else {
+
+      // The part of the edge crosses several cells. The area to its right
+      // is split into a triangle in the first cell, trapezoids in the
+      // middle cells and a triangle in the last cell.
+      const double s = 1.0 / (x1 - x0);
+      const double x0f = x0 - x0_floor;
+      const double a0 = 0.5 * s * (1.0 - x0f) * (1.0 - x0f);
+      const double x1f = x1 - x1_ceil + 1.0;
+      const double am = 0.5 * s * x1f * x1f;
+      row[x0i] += d * a0;
+      if (x1i == x0i + 2) {
+        row[x0i + 1] += d * (1.0 - a0 - am);
+      } else {
+        const double a1 = s * (1.5 - x0f);
+        row[x0i + 1] += d * (a1 - a0);
+        for (unsigned int xi = x0i + 2; xi < x1i - 1; ++xi) {
+          row[xi] += d * s;
+        }
+        const double a2 = a1 + (x1i - x0i - 3) * s;
+        row[x1i - 1] += d * (1.0 - a2 - am);
+      }
+      row[x1i] += d * am;
+    }
+    x = x_next;
+  }
+}
+
+// Function to mark the grid cells that the edge from a to b touches in
+// is_boundary, which holds ly rows of lx cells. Cells that only touch the
+// edge at their lower or left boundary are marked too, so that every
+// intersection of a ray with the edge lies in a marked cell.
+static void mark_boundary_cells(
+  XYPoint a,
+  XYPoint b,
+  const unsigned int lx,
+  const unsigned int ly,
+  std::vector<char> &is_boundary)
+{
+  if (a.y > b.y) {
+    std::swap(a, b);
+  }
+  const double first_row = std::max(0.0, std::ceil(a.y) - 1);
+  const double last_row = std::min(ly - 1.0, std::floor(b.y));
+  for (double row = first_row; row <= last_row; ++row) {
+
+    // x-coordinates of the part of the edge inside the row
+    double x0 = a.x;
+    double x1 = b.x;
+    if (a.y != b.y) {
+      const double dxdy = (b.x - a.x) / (b.y - a.y);
+      x0 = a.x + dxdy * (std::max(a.y, row) - a.y);
+      x1 = a.x + dxdy * (std::min(b.y, row + 1) - a.y);
+    }
+    const double first_col =
+      std::max(0.0, std::ceil(std::min(x0, x1)) - 1);
+    const double last_col = std::min(lx - 1.0, std::floor(std::max(x0, x1)));
+    const std::size_t row_begin = static_cast<std::size_t>(row) * lx;
+    for (double col = first_col; col <= last_col; ++col) {
+      is_boundary[row_begin + static_cast<std::size_t>(col)] = 1;
+    }
+  }
+}
+
+// Function to find the grid cells that are crossed by the boundary of a
+// GeoDiv. is_boundary is resized to ly rows of lx cells, in which they are
+// marked.
+static void find_boundary_cells(
+  const FlatGeometry &flat_geo_divs,
+  const unsigned int lx,
+  const unsigned int ly,
+  std::vector<char> &is_boundary)
+{
+  is_boundary.assign(static_cast<std::size_t>(lx) * ly, 0);
+  const auto &points = flat_geo_divs.points();
+  const auto &ring_offsets = flat_geo_divs.ring_offsets();
+  for (std::size_t r = 0; r + 1 < ring_offsets.size(); ++r) {
+    XYPoint prev_point = points[ring_offsets[r + 1] - 1];
+    for (std::size_t k = ring_offsets[r]; k < ring_offsets[r + 1]; ++k) {
+      mark_boundary_cells(prev_point, points[k], lx, ly, is_boundary);
+      prev_point = points[k];
+    }
+  }
+}
+
+// Function to set the first cell and the dimensions of cov so that they
+// cover the bounding box bb. Coordinates relative to the first cell are
+// non-negative. One extra column is needed for the right boundary and one
+// because accumulate_edge_coverage() may write a zero beyond it.
+static void set_coverage_bbox(const Bbox &bb, geo_div_coverage &cov)
+{
+  const double x_offset = std::floor(bb.xmin());
+  const double y_offset = std::floor(bb.ymin());
+  cov.x_begin = static_cast<int>(x_offset);
+  cov.y_begin = static_cast<int>(y_offset);
+  cov.n_cols = static_cast<unsigned int>(std::ceil(bb.xmax()) - x_offset) + 2;
+  cov.n_rows = static_cast<unsigned int>(std::ceil(bb.ymax()) - y_offset);
+}
+
+// Function to fill cov with the area of the GeoDiv with index gd_index in
+// flat_geo_divs inside each grid cell of its bounding box. The buffer
+// cov.area is reused.
+static void fill_coverage(
+  const FlatGeometry &flat_geo_divs,
+  const std::size_t gd_index,
+  geo_div_coverage &cov)
+{
+  set_coverage_bbox(flat_geo_divs.bbox(gd_index), cov);
+  const double x_offset = cov.x_begin;
+  const double y_offset = cov.y_begin;
+  cov.area.assign(static_cast<std::size_t>(cov.n_cols) * cov.n_rows, 0.0);
+  const auto &points = flat_geo_divs.points();
+  const auto &ring_offsets = flat_geo_divs.ring_offsets();
+  const auto &pwh_offsets = flat_geo_divs.pwh_offsets();
+  const auto &geo_div_offsets = flat_geo_divs.geo_div_offsets();
+  for (std::size_t r = pwh_offsets[geo_div_offsets[gd_index]];
+       r < pwh_offsets[geo_div_offsets[gd_index + 1]];
+       ++r) {
+    const XYPoint &last = points[ring_offsets[r + 1] - 1];
+    XYPoint prev_point(last.x - x_offset, last.y - y_offset);
+    for (std::size_t k = ring_offsets[r]; k < ring_offsets[r + 1]; ++k) {
+      const XYPoint curr_point(points[k].x - x_offset, points[k].y - y_offset);
+      accumulate_edge_coverage(
+        prev_point,
+        curr_point,
+        cov.n_cols,
+        cov.n_rows,
+        cov.area);
+      prev_point = curr_point;
+    }
+  }
+
+  // Prefix sums along the rows. Exterior rings are counterclockwise, so
+  // the accumulated areas are negative.
+  for (unsigned int y = 0; y < cov.n_rows; ++y) {
+    double cover = 0.0;
+    for (unsigned int x = 0; x < cov.n_cols; ++x) {
+      double &a = cov.area[static_cast<std::size_t>(y) * cov.n_cols + x];
+      cover += a;
+      a = -cover;
+    }
+  }
+}
+
+// Function to add the exact area of each GeoDiv inside each grid cell to
+// rho_num and rho_den. As in the scanline method, the weight of a GeoDiv in
+// a cell is (area inside the cell) * (area error of the GeoDiv). Unlike the
+// scanline method, gaps between neighboring GeoDivs are not assigned to
+// either GeoDiv. The coverage of the GeoDivs is computed in parallel and
+// added to rho_num and rho_den in the order of the GeoDivs, so that the
+// result does not depend on the number of threads. Each thread reuses one
+// coverage buffer of `coverages`, which it only fills again after adding
+// its previous GeoDiv. Hence, at most one bounding box per thread is held in
+// memory, even if many GeoDivs span most of the grid (e.g., multi-part
+// countries on world maps). Each buffer is reserved for the largest
+// bounding box, so that it does not grow when its thread gets a larger
+// GeoDiv in a later integration.
+static void add_exact_coverage(
+  const FlatGeometry &flat_geo_divs,
+  const std::vector<double> &target_densities,
+  const std::vector<double> &area_errors,
+  const unsigned int lx,
+  const unsigned int ly,
+  std::vector<geo_div_coverage> &coverages,
+  FTReal2d &rho_num,
+  FTReal2d &rho_den)
+{
+  const auto &geo_div_offsets = flat_geo_divs.geo_div_offsets();
+  const std::size_t n_geo_divs = flat_geo_divs.n_geo_divs();
+  std::size_t max_n_cells = 0;
+  for (std::size_t gd_index = 0; gd_index < n_geo_divs; ++gd_index) {
+    if (geo_div_offsets[gd_index] < geo_div_offsets[gd_index + 1]) {
+      geo_div_coverage cov;
+      set_coverage_bbox(flat_geo_divs.bbox(gd_index), cov);
+      max_n_cells = std::max(
+        max_n_cells,
+        static_cast<std::size_t>(cov.n_cols) * cov.n_rows);
+    }
+  }
+  coverages.resize(omp_get_max_threads());
+#pragma omp parallel default(none) shared( \
+  coverages,                               \
+  flat_geo_divs,                           \
+  geo_div_offsets,                         \
+  max_n_cells,                             \
+  n_geo_divs,                              \
+  target_densities,                        \
+  area_errors,                             \
+  lx,                                      \
+  ly,                                      \
+  rho_num,                                 \
+  rho_den)
+  {
+    geo_div_coverage &cov = coverages[omp_get_thread_num()];
+    cov.area.reserve(max_n_cells);
+#pragma omp for ordered schedule(dynamic)
+    for (std::size_t gd_index = 0; gd_index < n_geo_divs; ++gd_index) {
+      cov.n_cols = 0;
+      cov.n_rows = 0;
+      if (geo_div_offsets[gd_index] < geo_div_offsets[gd_index + 1]) {
+        fill_coverage(flat_geo_divs, gd_index, cov);
+      }
+
+      // Add the weighted areas to rho_num and rho_den
+#pragma omp ordered
+      {
+        const double target_density = target_densities[gd_index];
+        const double area_error = area_errors[gd_index];
+        for (unsigned int y = 0; y < cov.n_rows; ++y) {
+          const int j = cov.y_begin + static_cast<int>(y);
+          for (unsigned int x = 0; x < cov.n_cols; ++x) {
+            const int i = cov.x_begin + static_cast<int>(x);
+            const double a =
+              cov.area[static_cast<std::size_t>(y) * cov.n_cols + x];
+
+            // Skip cells outside the grid and rounding errors near zero
+            if (
+              i >= 0 && i < static_cast<int>(lx) && j >= 0 &&
+              j < static_cast<int>(ly) && a > 0.0) {
+              const double weight = area_error * a;
+              rho_num(i, j) += weight * target_density;
+              rho_den(i, j) += weight;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void InsetState::fill_with_density(
+  bool plot_density,
+  DensityRasterizer rasterizer)
 {
   // We assume that target areas that were zero or missing in the input have
   // already been replaced by
@@ -19,147 +303,268 @@ void InsetState::fill_with_density(bool plot_density)
   double mean_density = (1.0 - (initial_area_ / (lx_ * ly_))) /
                         (1.0 - (total_inset_area() / (lx_ * ly_)));
 
-#pragma omp parallel for default(none)
-
-  // Initially assign zero to all densities
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      rho_init_(i, j) = 0;
-    }
-  }
-
   // Density numerator and denominator for each graticule cell. The density of
   // a graticule cell can be calculated with (rho_num / rho_den). We initially
   // assign zero to all elements because we assume that all graticule cells
   // are outside any GeoDiv. Any graticule cell where rho_den is zero will be
   // filled with the mean_density.
+  // The numerator is accumulated in rho_init_, which becomes the input of the
+  // forward Fourier transform once it is divided by the denominator. The
+  // denominator is accumulated in rho_ft_, which the transform overwrites.
+  // Hence, no memory is allocated for rho_num and rho_den. The rays of row k
+  // only add to the cells (i, k), which lie in column i of both arrays. With
+  // a static schedule, each thread processes a contiguous block of rows, so
+  // that threads rarely write to the same cache line.
+  FTReal2d &rho_num = rho_init_;
+  FTReal2d &rho_den = rho_ft_;
+  const std::size_t n_cells = static_cast<std::size_t>(lx_) * ly_;
+  double *rho_num_array = rho_num.as_1d_array();
+  double *rho_den_array = rho_den.as_1d_array();
+#pragma omp parallel for default(none) \
+  shared(n_cells, rho_num_array, rho_den_array)
+  for (std::size_t c = 0; c < n_cells; ++c) {
+    rho_num_array[c] = 0.0;
+    rho_den_array[c] = 0.0;
+  }
 
-  // TODO: rho_num and rho_den could be a boost::multi_array<double, 2>.
-  std::vector<std::vector<double> > rho_num(lx_, std::vector<double>(ly_, 0));
-  std::vector<std::vector<double> > rho_den(lx_, std::vector<double>(ly_, 0));
+  // Target density and area error of each GeoDiv, indexed like geo_divs_.
+  // The polygons are rasterized from the flat coordinates.
+  // The arrays are kept in rasterizer_buffers_, like all arrays below.
+  const FlatGeometry &flat_geo_divs = this->flat_geo_divs();
+  std::vector<double> &target_densities = rasterizer_buffers_.target_densities;
+  std::vector<double> &area_errors = rasterizer_buffers_.area_errors;
+  target_densities.resize(geo_divs_.size());
+  area_errors.resize(geo_divs_.size());
+  for (unsigned int gd_index = 0; gd_index < geo_divs_.size(); ++gd_index) {
+    const unsigned int id_index = geo_divs_[gd_index].id_index();
+    target_densities[gd_index] =
+      target_areas_[id_index] / flat_geo_divs.area(gd_index);
+    area_errors[gd_index] = area_errors_[id_index];
+  }
 
-  // Resolution with which we sample polygons. "resolution" is the number of
-  // horizontal "test rays" between each of the ly consecutive horizontal
-  // graticule lines.
-  const unsigned int resolution = default_resolution;
-  auto intersections_with_rays = intersec_with_parallel_to('x', resolution);
+  if (rasterizer == DensityRasterizer::exact) {
+    add_exact_coverage(
+      flat_geo_divs,
+      target_densities,
+      area_errors,
+      lx_,
+      ly_,
+      rasterizer_buffers_.coverages,
+      rho_num,
+      rho_den);
+  } else {
 
-  // Determine rho's numerator and denominator:
-  // - rho_num is the sum of (weight * target_density) for each segment of a
-  //   ray that is inside a GeoDiv.
-  // - rho_den is the sum of the weights of a ray that is inside a GeoDiv.
-  // The weight of a segment of a ray that is inside a GeoDiv is equal to
-  // (length of the segment inside the geo_div) * (area error of the geodiv).
+    // Resolution with which we sample polygons. "resolution" is the number of
+    // horizontal "test rays" between each of the ly consecutive horizontal
+    // graticule lines.
+    const unsigned int resolution = default_resolution;
+    const std::vector<std::vector<intersection> > &intersections_with_rays =
+      rasterizer_buffers_.scanlines;
+    intersec_with_parallel_to('x', resolution, rasterizer_buffers_.scanlines);
 
+    // In adaptive mode, the rays above only sample the cells that a boundary
+    // crosses. For each cell (i, k), next_sampled_cell[k * (lx_ + 1) + i] is
+    // the first boundary cell in row k at or after i, or lx_ if there is
+    // none. The remaining cells lie completely inside one GeoDiv or outside
+    // all GeoDivs. They are filled with one ray per row further below.
+    const bool adaptive = (rasterizer == DensityRasterizer::adaptive);
+    std::vector<char> &is_boundary = rasterizer_buffers_.is_boundary;
+    std::vector<unsigned int> &next_sampled_cell =
+      rasterizer_buffers_.next_sampled_cell;
+    if (adaptive) {
+      find_boundary_cells(flat_geo_divs, lx_, ly_, is_boundary);
+      next_sampled_cell.resize(static_cast<std::size_t>(lx_ + 1) * ly_);
+      std::size_t n_boundary_cells = 0;
 #pragma omp parallel for default(none) \
-  shared(intersections_with_rays, rho_den, rho_num, std::cerr)
-  for (unsigned int k = 0; k < ly_; ++k) {
-
-    // Iterate over each of the rays between the graticule lines y = k and
-    // y = k+1
-    for (double y = k + 0.5 / resolution; y < k + 1; y += 1.0 / resolution) {
-
-      // Intersections for one ray
-      auto intersections_at_y = intersections_with_rays[std::lround(
-        (y - 0.5 / resolution) * resolution)];
-
-      // Sort intersections in ascending order
-      std::sort(intersections_at_y.begin(), intersections_at_y.end());
-
-      // If the ray has intersections, we fill any empty spaces between
-      // GeoDivs. Please note that we cannot write the loop condition as:
-      // i < intersections.size() - 1
-      // because intersection.size() is an unsigned integer. If
-      // intersections.size() equals zero, then the right-hand side would
-      // evaluate to a large positive number instead of -1. In this case,
-      // we would erroneously enter the loop.
-      for (unsigned int i = 1; i + 1 < intersections_at_y.size(); i += 2) {
-        const double left_x = intersections_at_y[i].x();
-        const double right_x = intersections_at_y[i + 1].x();
-        if (left_x != right_x) {
-          if (ceil(left_x) == ceil(right_x)) {
-
-            // The intersections are in the same graticule cell. The ray
-            // enters and leaves a GeoDiv in this cell. We weigh the density
-            // of the cell by the GeoDiv's area error.
-            const double weight =
-              area_error_at(intersections_at_y[i].geo_div_id) *
-              (right_x - left_x);
-            const double target_dens = intersections_at_y[i].target_density;
-            const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
-            rho_num[uilx][k] += weight * target_dens;
-            rho_den[uilx][k] += weight;
+  shared(is_boundary, next_sampled_cell) reduction(+ : n_boundary_cells)
+      for (unsigned int k = 0; k < ly_; ++k) {
+        const std::size_t row = static_cast<std::size_t>(k) * (lx_ + 1);
+        next_sampled_cell[row + lx_] = lx_;
+        for (unsigned int i = lx_; i-- > 0;) {
+          if (is_boundary[static_cast<std::size_t>(k) * lx_ + i]) {
+            next_sampled_cell[row + i] = i;
+            ++n_boundary_cells;
+          } else {
+            next_sampled_cell[row + i] = next_sampled_cell[row + i + 1];
           }
         }
-
-        // Fill last exiting intersection with GeoDiv where part of ray inside
-        // the graticule cell is inside the GeoDiv
-        const auto last_x =
-          static_cast<unsigned int>(intersections_at_y.back().x());
-        const double last_weight =
-          area_error_at(intersections_at_y.back().geo_div_id) *
-          (ceil(last_x) - last_x);
-        const double last_target_density =
-          intersections_at_y.back().target_density;
-        const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
-        rho_num[uilx][k] += last_weight * last_target_density;
-        rho_den[uilx][k] += last_weight;
       }
+      std::cerr << "Supersampling " << n_boundary_cells << " of "
+                << lx_ * ly_ << " grid cells ("
+                << 100.0 * n_boundary_cells / (lx_ * ly_) << "%)"
+                << std::endl;
+    }
 
-      // Fill GeoDivs by iterating over intersections
-      for (unsigned int i = 0; i < intersections_at_y.size(); i += 2) {
-        const double left_x = intersections_at_y[i].x();
-        const double right_x = intersections_at_y[i + 1].x();
-
-        // Check for intersection of polygons, holes and GeoDivs
-        // TODO: Decide whether to comment out? (probably not)
-        if (
-          intersections_at_y[i].ray_enters ==
-          intersections_at_y[i + 1].ray_enters) {
-
-          // Highlight where intersection is present
-          std::cerr << "\nInvalid Geometry!" << std::endl;
-          std::cerr << "Intersection of Polygons/Holes/Geodivs" << std::endl;
-          std::cerr << "Y-coordinate: " << y << std::endl;
-          std::cerr << "Left X-coordinate: " << left_x << std::endl;
-          std::cerr << "Right X-coordinate: " << right_x << std::endl;
-          std::cerr << std::endl;
-          // _Exit(8026519);
+    // Determine rho's numerator and denominator:
+    // - rho_num is the sum of (weight * target_density) for each segment of a
+    //   ray that is inside a GeoDiv.
+    // - rho_den is the sum of the weights of a ray that is inside a GeoDiv.
+    // The weight of a segment of a ray that is inside a GeoDiv is equal to
+    // (length of the segment inside the geo_div) * (area error of the geodiv).
+
+#pragma omp parallel for default(none) shared( \
+  adaptive,                                    \
+  area_errors,                                 \
+  intersections_with_rays,                     \
+  next_sampled_cell,                           \
+  rho_den,                                     \
+  rho_num,                                     \
+  std::cerr,                                   \
+  target_densities) schedule(static)
+    for (unsigned int k = 0; k < ly_; ++k) {
+
+      // Iterate over each of the rays between the graticule lines y = k and
+      // y = k+1
+      for (double y = k + 0.5 / resolution; y < k + 1; y += 1.0 / resolution) {
+
+        // Intersections for one ray, sorted in ascending order
+        const auto &intersections_at_y = intersections_with_rays[std::lround(
+          (y - 0.5 / resolution) * resolution)];
+
+        // If the ray has intersections, we fill any empty spaces between
+        // GeoDivs. Please note that we cannot write the loop condition as:
+        // i < intersections.size() - 1
+        // because intersection.size() is an unsigned integer. If
+        // intersections.size() equals zero, then the right-hand side would
+        // evaluate to a large positive number instead of -1. In this case,
+        // we would erroneously enter the loop.
+        for (unsigned int i = 1; i + 1 < intersections_at_y.size(); i += 2) {
+          const double left_x = intersections_at_y[i].x();
+          const double right_x = intersections_at_y[i + 1].x();
+          if (left_x != right_x) {
+            if (ceil(left_x) == ceil(right_x)) {
+
+              // The intersections are in the same graticule cell. The ray
+              // enters and leaves a GeoDiv in this cell. We weigh the density
+              // of the cell by the GeoDiv's area error.
+              const double weight =
+                area_errors[intersections_at_y[i].geo_div_index] *
+                (right_x - left_x);
+              const double target_dens =
+                target_densities[intersections_at_y[i].geo_div_index];
+              const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
+              rho_num(uilx, k) += weight * target_dens;
+              rho_den(uilx, k) += weight;
+            }
+          }
+
+          // Fill last exiting intersection with GeoDiv where part of ray inside
+          // the graticule cell is inside the GeoDiv
+          const auto last_x =
+            static_cast<unsigned int>(intersections_at_y.back().x());
+          const double last_weight =
+            area_errors[intersections_at_y.back().geo_div_index] *
+            (ceil(last_x) - last_x);
+          const double last_target_density =
+            target_densities[intersections_at_y.back().geo_div_index];
+          const auto uilx = static_cast<unsigned int>(ceil(left_x) - 1);
+          rho_num(uilx, k) += last_weight * last_target_density;
+          rho_den(uilx, k) += last_weight;
+        }
+
+        // Fill GeoDivs by iterating over intersections
+        for (unsigned int i = 0; i < intersections_at_y.size(); i += 2) {
+          const double left_x = intersections_at_y[i].x();
+          const double right_x = intersections_at_y[i + 1].x();
+
+          // Check for intersection of polygons, holes and GeoDivs
+          // TODO: Decide whether to comment out? (probably not)
+          if (
+            intersections_at_y[i].ray_enters ==
+            intersections_at_y[i + 1].ray_enters) {
+
+            // Highlight where intersection is present
+            std::cerr << "\nInvalid Geometry!" << std::endl;
+            std::cerr << "Intersection of Polygons/Holes/Geodivs" << std::endl;
+            std::cerr << "Y-coordinate: " << y << std::endl;
+            std::cerr << "Left X-coordinate: " << left_x << std::endl;
+            std::cerr << "Right X-coordinate: " << right_x << std::endl;
+            std::cerr << std::endl;
+            // _Exit(8026519);
+          }
+
+          // Fill each cell between intersections
+          // TODO: WE ENCOUNTERED ISSUES WITH THE NEXT FOR_LOOP; THUS, WE
+          // TEMPORARILY REPLACED IT WITH THE VERSION COMMENTED-OUT BELOW.
+          // HOWEVER, NONE OF OUR CURRENT EXAMPLES EXHIBIT THIS PROBLEM.
+          // for (unsigned int m = std::max(ceil(left_x), 1.0);
+          //                   m <= std::max(ceil(right_x), 1.0);
+          //                   ++m) {
+          for (unsigned int m = ceil(left_x); m <= ceil(right_x); ++m) {
+
+            // Skip to the next boundary cell in adaptive mode
+            if (adaptive) {
+              m = next_sampled_cell
+                    [static_cast<std::size_t>(k) * (lx_ + 1) + m - 1] +
+                  1;
+              if (m > ceil(right_x)) {
+                break;
+              }
+            }
+            double weight = area_errors[intersections_at_y[i].geo_div_index];
+            if (ceil(left_x) == ceil(right_x)) {
+              weight *= (right_x - left_x);
+            } else if (m == ceil(left_x)) {
+              weight *= (ceil(left_x) - left_x);
+            } else if (m == ceil(right_x)) {
+              weight *= (right_x - floor(right_x));
+            }
+            const double target_dens =
+              target_densities[intersections_at_y[i].geo_div_index];
+            rho_num(m - 1, k) += weight * target_dens;
+            rho_den(m - 1, k) += weight;
+          }
         }
+      }
+    }
 
-        // Fill each cell between intersections
-        // TODO: WE ENCOUNTERED ISSUES WITH THE NEXT FOR_LOOP; THUS, WE
-        // TEMPORARILY REPLACED IT WITH THE VERSION COMMENTED-OUT BELOW.
-        // HOWEVER, NONE OF OUR CURRENT EXAMPLES EXHIBIT THIS PROBLEM.
-        // for (unsigned int m = std::max(ceil(left_x), 1.0);
-        //                   m <= std::max(ceil(right_x), 1.0);
-        //                   ++m) {
-        for (unsigned int m = ceil(left_x); m <= ceil(right_x); ++m) {
-          double weight = area_error_at(intersections_at_y[i].geo_div_id);
-          if (ceil(left_x) == ceil(right_x)) {
-            weight *= (right_x - left_x);
-          } else if (m == ceil(left_x)) {
-            weight *= (ceil(left_x) - left_x);
-          } else if (m == ceil(right_x)) {
-            weight *= (right_x - floor(right_x));
+    // Fill the cells that no boundary crosses with one ray through the
+    // middle of each row. Such a cell is either completely inside the
+    // GeoDiv of the enclosing pair of intersections or outside all GeoDivs.
+    // Its weight equals that of `resolution` rays through the whole cell.
+    if (adaptive) {
+      const std::vector<std::vector<intersection> >
+        &intersections_with_coarse_rays = rasterizer_buffers_.coarse_scanlines;
+      intersec_with_parallel_to('x', 1, rasterizer_buffers_.coarse_scanlines);
+#pragma omp parallel for default(none) shared( \
+  area_errors,                                 \
+  intersections_with_coarse_rays,              \
+  is_boundary,                                 \
+  resolution,                                  \
+  rho_den,                                     \
+  rho_num,                                     \
+  target_densities) schedule(static)
+      for (unsigned int k = 0; k < ly_; ++k) {
+        const auto &intersections_at_y = intersections_with_coarse_rays[k];
+        for (unsigned int i = 0; i + 1 < intersections_at_y.size(); i += 2) {
+          const unsigned int gd_index = intersections_at_y[i].geo_div_index;
+          const double weight = area_errors[gd_index] * resolution;
+          const double target_dens = target_densities[gd_index];
+          const auto first_cell = static_cast<unsigned int>(
+            std::max(0.0, ceil(intersections_at_y[i].x()) - 1));
+          const auto last_cell = static_cast<unsigned int>(std::min(
+            lx_ - 1.0,
+            ceil(intersections_at_y[i + 1].x()) - 1));
+          for (unsigned int m = first_cell; m <= last_cell; ++m) {
+            if (!is_boundary[static_cast<std::size_t>(k) * lx_ + m]) {
+              rho_num(m, k) += weight * target_dens;
+              rho_den(m, k) += weight;
+            }
           }
-          const double target_dens = intersections_at_y[i].target_density;
-          rho_num[m - 1][k] += weight * target_dens;
-          rho_den[m - 1][k] += weight;
         }
       }
     }
   }
 
-  // Fill rho_init with the ratio of rho_num to rho_den
-#pragma omp parallel for default(none) shared(mean_density, rho_den, rho_num)
-  for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
-      if (rho_den[i][j] == 0) {
-        rho_init_(i, j) = mean_density;
-      } else {
-        rho_init_(i, j) = rho_num[i][j] / rho_den[i][j];
-      }
+  // Fill rho_init with the ratio of rho_num to rho_den. Because rho_num is
+  // stored in rho_init_, the ratio is written in place.
+#pragma omp parallel for default(none) \
+  shared(mean_density, n_cells, rho_num_array, rho_den_array)
+  for (std::size_t c = 0; c < n_cells; ++c) {
+    if (rho_den_array[c] == 0) {
+      rho_num_array[c] = mean_density;
+    } else {
+      rho_num_array[c] /= rho_den_array[c];
     }
   }
   if (plot_density) {
@@ -0,0 +1,172 @@
+#include "flat_geometry.h"
+#include "constants.h"
+#include <algorithm>
+#include <cassert>
+
+double FlatGeometry::area(const std::size_t gd_index) const
+{
+  assert(areas_and_bboxes_are_current_);
+  return areas_[gd_index];
+}
+
+void FlatGeometry::assign(const std::vector<GeoDiv> &geo_divs)
+{
+  // Offsets of the polygons, rings and points. Only the rings are visited.
+  geo_div_offsets_.resize(1);
+  pwh_offsets_.resize(1);
+  ring_offsets_.resize(1);
+  for (const auto &gd : geo_divs) {
+    for (const auto &pwh : gd.polygons_with_holes()) {
+      const auto &ext_ring = pwh.outer_boundary();
+      ring_offsets_.push_back(ring_offsets_.back() + ext_ring.size());
+      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+        ring_offsets_.push_back(ring_offsets_.back() + h->size());
+      }
+      pwh_offsets_.push_back(ring_offsets_.size() - 1);
+    }
+    geo_div_offsets_.push_back(pwh_offsets_.size() - 1);
+  }
+
+  // Copy the coordinates. Each GeoDiv writes to its own part of points_.
+  // The area and bounding box are computed while the points are in cache.
+  points_.resize(ring_offsets_.back());
+  areas_.resize(geo_divs.size());
+  bboxes_.resize(geo_divs.size());
+#pragma omp parallel for default(none) shared(geo_divs) schedule(dynamic)
+  for (std::size_t gd_index = 0; gd_index < geo_divs.size(); ++gd_index) {
+    std::size_t ring_index = pwh_offsets_[geo_div_offsets_[gd_index]];
+    const auto copy_ring = [this, &ring_index](const Polygon &ring) {
+      XYPoint *point = points_.data() + ring_offsets_[ring_index++];
+      for (const auto &p : ring) {
+        *point++ = XYPoint(p.x(), p.y());
+      }
+    };
+    for (const auto &pwh : geo_divs[gd_index].polygons_with_holes()) {
+      copy_ring(pwh.outer_boundary());
+      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+        copy_ring(*h);
+      }
+    }
+    update_area_and_bbox(gd_index);
+  }
+  areas_and_bboxes_are_current_ = true;
+}
+
+Bbox FlatGeometry::bbox(const std::size_t gd_index) const
+{
+  assert(areas_and_bboxes_are_current_);
+  return bboxes_[gd_index];
+}
+
+const std::vector<std::size_t> &FlatGeometry::geo_div_offsets() const
+{
+  return geo_div_offsets_;
+}
+
+std::size_t FlatGeometry::n_geo_divs() const
+{
+  return geo_div_offsets_.size() - 1;
+}
+
+const std::vector<XYPoint> &FlatGeometry::points() const
+{
+  return points_;
+}
+
+const std::vector<std::size_t> &FlatGeometry::pwh_offsets() const
+{
+  return pwh_offsets_;
+}
+
+std::vector<XYPoint> *FlatGeometry::ref_to_points()
+{
+  areas_and_bboxes_are_current_ = false;
+  return &points_;
+}
+
+const std::vector<std::size_t> &FlatGeometry::ring_offsets() const
+{
+  return ring_offsets_;
+}
+
+void FlatGeometry::update_area_and_bbox(const std::size_t gd_index)
+{
+  // The sums are taken in the same order as in
+  // GeoDiv::update_area_and_bbox(), so that both return the same area
+  double area = 0.0;
+  double xmin = dbl_inf;
+  double ymin = dbl_inf;
+  double xmax = -dbl_inf;
+  double ymax = -dbl_inf;
+  for (std::size_t pwh_index = geo_div_offsets_[gd_index];
+       pwh_index < geo_div_offsets_[gd_index + 1];
+       ++pwh_index) {
+    const std::size_t ext_ring_index = pwh_offsets_[pwh_index];
+    for (std::size_t ring_index = ext_ring_index;
+         ring_index < pwh_offsets_[pwh_index + 1];
+         ++ring_index) {
+      const XYPoint *ring = points_.data() + ring_offsets_[ring_index];
+      const std::size_t n = ring_offsets_[ring_index + 1] -
+                            ring_offsets_[ring_index];
+      double ring_area = 0.0;
+      for (std::size_t i = 0, j = n - 1; i < n; j = i++) {
+        ring_area += (ring[j].x - ring[i].x) * (ring[j].y + ring[i].y);
+      }
+      area += ring_area;
+
+      // The holes lie inside the exterior ring. Hence, they do not change
+      // the bounding box.
+      if (ring_index == ext_ring_index) {
+        for (std::size_t i = 0; i < n; ++i) {
+          xmin = std::min(xmin, ring[i].x);
+          ymin = std::min(ymin, ring[i].y);
+          xmax = std::max(xmax, ring[i].x);
+          ymax = std::max(ymax, ring[i].y);
+        }
+      }
+    }
+  }
+  areas_[gd_index] = area / 2;
+  bboxes_[gd_index] =
+    (xmin <= xmax) ? Bbox(xmin, ymin, xmax, ymax) : Bbox();
+}
+
+void FlatGeometry::update_areas_and_bboxes()
+{
+  if (areas_and_bboxes_are_current_) {
+    return;
+  }
+  const std::size_t n = n_geo_divs();
+#pragma omp parallel for default(none) shared(n) schedule(dynamic)
+  for (std::size_t gd_index = 0; gd_index < n; ++gd_index) {
+    update_area_and_bbox(gd_index);
+  }
+  areas_and_bboxes_are_current_ = true;
+}
+
+void FlatGeometry::write_to(std::vector<GeoDiv> &geo_divs) const
+{
+#pragma omp parallel for default(none) shared(geo_divs) schedule(dynamic)
+  for (std::size_t gd_index = 0; gd_index < geo_divs.size(); ++gd_index) {
+    std::size_t ring_index = pwh_offsets_[geo_div_offsets_[gd_index]];
+    const auto copy_ring = [this, &ring_index](Polygon &ring) {
+      const XYPoint *point = points_.data() + ring_offsets_[ring_index++];
+      for (auto &p : ring) {
+        p = Point(point->x, point->y);
+        ++point;
+      }
+    };
+    GeoDiv &gd = geo_divs[gd_index];
+    for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
+      copy_ring(pwh.outer_boundary());
+      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+        copy_ring(*h);
+      }
+    }
+    if (areas_and_bboxes_are_current_) {
+      gd.set_area_and_bbox(areas_[gd_index], bboxes_[gd_index]);
+    } else {
+      gd.update_area_and_bbox();
+    }
+  }
+}
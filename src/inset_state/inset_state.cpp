@@ -1,17 +1,22 @@
 #include "inset_state.h"
 #include "constants.h"
 #include "round_point.h"
+#include <bit>
+#include <cassert>
 #include <cmath>
 #include <iostream>
 #include <utility>
 
 InsetState::InsetState()
+    : integration_workspace_(std::make_shared<IntegrationWorkspace>())
 {
   initial_area_ = 0.0;
   n_finished_integrations_ = 0;
 }
 
-InsetState::InsetState(std::string pos) : pos_(std::move(pos))
+InsetState::InsetState(std::string pos)
+    : integration_workspace_(std::make_shared<IntegrationWorkspace>()),
+      pos_(std::move(pos))
 {
   initial_area_ = 0.0;
   n_finished_integrations_ = 0;
@@ -26,30 +31,11 @@ void InsetState::create_delaunay_t()
   // Avoid collisions in hash table
   points.reserve(8192);
   points.max_load_factor(0.5);
-  for (const auto &gd : geo_divs_) {
-    for (const auto &pwh : gd.polygons_with_holes()) {
-      const Polygon ext_ring = pwh.outer_boundary();
-
-      // Get exterior ring coordinates
-      for (const auto &i : ext_ring) {
-        points.insert(Point(i[0], i[1]));
-      }
 
-      // Get holes of polygon with holes
-      //      for (auto hci = pwh.holes_begin(); hci != pwh.holes_end(); ++hci)
-      //      {
-      //        const Polygon &hole = *hci;
-      //        for (auto i : hole) {
-      //          points.insert(Point(i[0], i[1]));
-      //        }
-      //      }
-      for (auto hci = pwh.holes_begin(); hci != pwh.holes_end(); ++hci) {
-        const Polygon &hole = *hci;
-        for (const auto &i : hole) {
-          points.insert(Point(i[0], i[1]));
-        }
-      }
-    }
+  // The flat array contains the points of the exterior rings and holes in
+  // the order of the GeoDivs
+  for (const auto &p : flat_geo_divs().points()) {
+    points.insert(Point(p.x, p.y));
   }
 
   // Add boundary points of mapping domain
@@ -63,10 +49,12 @@ void InsetState::create_delaunay_t()
   std::copy(points.begin(), points.end(), std::back_inserter(points_vec));
 
   // Create the quadtree and 'grade' it so that neighboring quadtree leaves
-  // differ by a depth that can only be 0 or 1.
+  // differ by a depth that can only be 0 or 1. The root node is a square
+  // with side length max(lx_, ly_). The maximum depth is chosen such that
+  // the smallest leaves are no larger than one grid cell, also if lx_ and
+  // ly_ are not powers of 2.
   Quadtree qt(points_vec, Quadtree::PointMap(), 1);
-  const unsigned int depth =
-    static_cast<unsigned int>(std::max(log2(lx_), log2(ly_)));
+  const unsigned int depth = std::bit_width(std::max(lx_, ly_) - 1);
   std::cerr << "Using Quadtree depth: " << depth << std::endl;
   qt.refine(
     depth,
@@ -118,51 +106,52 @@ void InsetState::create_delaunay_t()
 
 double InsetState::area_error_at(const std::string &id) const
 {
-  return area_errors_.at(id);
+  return area_errors_[id_index(id)];
 }
 
 Bbox InsetState::bbox(bool original_bbox) const
 {
-  auto &geo_divs = original_bbox ? geo_divs_original_ : geo_divs_;
+  const FlatGeometry &flat_geo_divs = this->flat_geo_divs(original_bbox);
+  const std::size_t n_geo_divs = flat_geo_divs.n_geo_divs();
+
   // Find joint bounding box for all "polygons with holes" in this inset
   double inset_xmin = dbl_inf;
   double inset_xmax = -dbl_inf;
   double inset_ymin = dbl_inf;
   double inset_ymax = -dbl_inf;
-#pragma omp parallel for default(none) shared(geo_divs) \
-  reduction(min                                         \
-            : inset_xmin, inset_ymin) reduction(max     \
+#pragma omp parallel for default(none) shared(flat_geo_divs, n_geo_divs) \
+  reduction(min                                                          \
+            : inset_xmin, inset_ymin) reduction(max                      \
                                                 : inset_xmax, inset_ymax)
-  for (const auto &gd : geo_divs) {
-    for (const auto &pwh : gd.polygons_with_holes()) {
-      const auto bb = pwh.bbox();
-      inset_xmin = std::min(bb.xmin(), inset_xmin);
-      inset_ymin = std::min(bb.ymin(), inset_ymin);
-      inset_xmax = std::max(bb.xmax(), inset_xmax);
-      inset_ymax = std::max(bb.ymax(), inset_ymax);
-    }
+  for (std::size_t gd_index = 0; gd_index < n_geo_divs; ++gd_index) {
+    const auto bb = flat_geo_divs.bbox(gd_index);
+    inset_xmin = std::min(bb.xmin(), inset_xmin);
+    inset_ymin = std::min(bb.ymin(), inset_ymin);
+    inset_xmax = std::max(bb.xmax(), inset_xmax);
+    inset_ymax = std::max(bb.ymax(), inset_ymax);
   }
   return {inset_xmin, inset_ymin, inset_xmax, inset_ymax};
 }
 
 Color InsetState::color_at(const std::string &id) const
 {
-  return colors_.at(id);
+  return colors_[id_index(id)].value();
 }
 
 bool InsetState::color_found(const std::string &id) const
 {
-  return colors_.count(id);
+  const auto it = id_indices_.find(id);
+  return it != id_indices_.end() && colors_[it->second].has_value();
 }
 
 bool InsetState::colors_empty() const
 {
-  return colors_.empty();
+  return n_colors_ == 0;
 }
 
 unsigned int InsetState::colors_size() const
 {
-  return colors_.size();
+  return n_colors_;
 }
 
 void InsetState::destroy_fftw_plans_for_rho()
@@ -181,9 +170,29 @@ void InsetState::execute_fftw_fwd_plan() const
   fftw_execute(fwd_plan_for_rho_);
 }
 
-std::vector<GeoDiv> InsetState::geo_divs() const
+const FlatGeometry &InsetState::flat_geo_divs(const bool original) const
+{
+  assert(
+    (original ? up_to_date_original_ : up_to_date_) != UpToDate::geo_divs);
+  return original ? flat_geo_divs_original_ : flat_geo_divs_;
+}
+
+const std::vector<GeoDiv> &InsetState::geo_divs(const bool original) const
+{
+  assert(
+    (original ? up_to_date_original_ : up_to_date_) !=
+    UpToDate::flat_geo_divs);
+  return original ? geo_divs_original_ : geo_divs_;
+}
+
+const std::string &InsetState::id_at(const unsigned int id_index) const
+{
+  return ids_[id_index];
+}
+
+unsigned int InsetState::id_index(const std::string &id) const
 {
-  return geo_divs_;
+  return id_indices_.at(id);
 }
 
 void InsetState::increment_integration()
@@ -206,41 +215,50 @@ void InsetState::initialize_cum_proj()
 
 void InsetState::insert_color(const std::string &id, const Color c)
 {
-  if (colors_.count(id)) {
-    colors_.erase(id);
+  std::optional<Color> &color = colors_[intern_id(id)];
+  if (!color) {
+    ++n_colors_;
   }
-  colors_.insert(std::pair<std::string, Color>(id, c));
+  color = c;
 }
 
 void InsetState::insert_color(const std::string &id, std::string color)
 {
-  if (colors_.count(id)) {
-    colors_.erase(id);
-  }
-
   // From
   // https://stackoverflow.com/questions/313970/how-to-convert-stdstring-to-lower-case
   std::transform(color.begin(), color.end(), color.begin(), ::tolower);
-  const Color c(color);
-  colors_.insert(std::pair<std::string, Color>(id, c));
+  insert_color(id, Color(color));
 }
 
 void InsetState::insert_label(const std::string &id, const std::string &label)
 {
-  labels_.insert(std::pair<std::string, std::string>(id, label));
+  labels_[intern_id(id)] = label;
 }
 
 void InsetState::insert_target_area(const std::string &id, const double area)
 {
-  target_areas_.insert(std::pair<std::string, double>(id, area));
+  target_areas_[intern_id(id)] = area;
 }
 
 void InsetState::insert_whether_input_target_area_is_missing(
   const std::string &id,
   const bool is_missing)
 {
-  is_input_target_area_missing_.insert(
-    std::pair<std::string, bool>(id, is_missing));
+  is_input_target_area_missing_[intern_id(id)] = is_missing;
+}
+
+unsigned int InsetState::intern_id(const std::string &id)
+{
+  const auto [it, is_new] = id_indices_.try_emplace(id, id_indices_.size());
+  if (is_new) {
+    ids_.push_back(id);
+    area_errors_.push_back(0.0);
+    colors_.emplace_back();
+    is_input_target_area_missing_.push_back(false);
+    labels_.emplace_back();
+    target_areas_.push_back(0.0);
+  }
+  return it->second;
 }
 
 std::string InsetState::inset_name() const
@@ -248,9 +266,14 @@ std::string InsetState::inset_name() const
   return inset_name_;
 }
 
+std::shared_ptr<IntegrationWorkspace> InsetState::integration_workspace() const
+{
+  return integration_workspace_;
+}
+
 bool InsetState::is_input_target_area_missing(const std::string &id) const
 {
-  return is_input_target_area_missing_.at(id);
+  return is_input_target_area_missing_[id_index(id)];
 }
 
 unsigned int InsetState::lx() const
@@ -263,8 +286,10 @@ unsigned int InsetState::ly() const
   return ly_;
 }
 
-void InsetState::make_fftw_plans_for_rho()
+void InsetState::make_fftw_plans_for_rho(const unsigned int planner_flag)
 {
+  // Except with FFTW_ESTIMATE, the planner overwrites the arrays. Hence, the
+  // plans must be made before the density is written to rho_init_.
   fwd_plan_for_rho_ = fftw_plan_r2r_2d(
     static_cast<int>(lx_),  // fftw_plan_...() uses signed integers.
     static_cast<int>(ly_),
@@ -272,7 +297,7 @@ void InsetState::make_fftw_plans_for_rho()
     rho_ft_.as_1d_array(),
     FFTW_REDFT10,
     FFTW_REDFT10,
-    FFTW_ESTIMATE);
+    planner_flag);
   bwd_plan_for_rho_ = fftw_plan_r2r_2d(
     static_cast<int>(lx_),
     static_cast<int>(ly_),
@@ -280,17 +305,18 @@ void InsetState::make_fftw_plans_for_rho()
     rho_init_.as_1d_array(),
     FFTW_REDFT01,
     FFTW_REDFT01,
-    FFTW_ESTIMATE);
+    planner_flag);
 }
 
 struct max_area_error_info InsetState::max_area_error() const
 {
   double value = -dbl_inf;
-  std::string worst_gd;
-  for (const auto &[gd_id, area_error] : area_errors_) {
+  unsigned int worst_gd = 0;
+  for (const auto &gd : geo_divs_) {
+    const double area_error = area_errors_[gd.id_index()];
     if (area_error > value) {
       value = area_error;
-      worst_gd = gd_id;
+      worst_gd = gd.id_index();
     }
   }
   return {value, worst_gd};
@@ -331,9 +357,8 @@ void InsetState::normalize_target_area()
 
   // Assign normalized target area to GeoDivs
   for (const auto &gd : geo_divs_) {
-    double normalized_target_area =
-      (target_area_at(gd.id()) / ta) * initial_area;
-    replace_target_area(gd.id(), normalized_target_area);
+    double &target_area = target_areas_[gd.id_index()];
+    target_area = (target_area / ta) * initial_area;
   }
 }
 
@@ -349,7 +374,23 @@ double InsetState::area_drift() const
 
 void InsetState::push_back(const GeoDiv &gd)
 {
-  geo_divs_.push_back(gd);
+  std::vector<GeoDiv> &geo_divs = *ref_to_geo_divs();
+  geo_divs.push_back(gd);
+  geo_divs.back().update_area_and_bbox();
+}
+
+FlatGeometry *InsetState::ref_to_flat_geo_divs(const bool original)
+{
+  sync_flat_geo_divs(original);
+  (original ? up_to_date_original_ : up_to_date_) = UpToDate::flat_geo_divs;
+  return original ? &flat_geo_divs_original_ : &flat_geo_divs_;
+}
+
+std::vector<GeoDiv> *InsetState::ref_to_geo_divs(const bool original)
+{
+  sync_geo_divs(original);
+  (original ? up_to_date_original_ : up_to_date_) = UpToDate::geo_divs;
+  return original ? &geo_divs_original_ : &geo_divs_;
 }
 
 FTReal2d *InsetState::ref_to_rho_ft()
@@ -365,11 +406,13 @@ FTReal2d *InsetState::ref_to_rho_init()
 void InsetState::remove_tiny_polygons(const double &minimum_polygon_size)
 {
   const double threshold = total_inset_area() * minimum_polygon_size;
+  std::vector<GeoDiv> &geo_divs = *ref_to_geo_divs();
   std::vector<GeoDiv> geo_divs_cleaned;
+  geo_divs_cleaned.reserve(geo_divs.size());
 
   // Iterate over GeoDivs
-  for (auto &gd : geo_divs_) {
-    GeoDiv gd_cleaned(gd.id());
+  for (auto &gd : geo_divs) {
+    GeoDiv gd_cleaned(gd.id(), gd.id_index());
 
     // Sort polygons with holes according to area
     gd.sort_pwh_descending_by_area();
@@ -381,33 +424,38 @@ void InsetState::remove_tiny_polygons(const double &minimum_polygon_size)
         gd_cleaned.push_back(pwhs[i]);
       }
     }
-    geo_divs_cleaned.push_back(gd_cleaned);
+    gd_cleaned.update_area_and_bbox();
+    geo_divs_cleaned.push_back(std::move(gd_cleaned));
   }
-  geo_divs_.clear();
-  geo_divs_ = geo_divs_cleaned;
+  geo_divs = std::move(geo_divs_cleaned);
+  sync_flat_geo_divs();
 }
 
 void InsetState::replace_target_area(const std::string &id, const double area)
 {
-  target_areas_[id] = area;
+  target_areas_[id_index(id)] = area;
 }
 
 void InsetState::set_area_errors()
 {
   // Formula for relative area error:
   // area_on_cartogram / target_area - 1
+  const FlatGeometry &flat_geo_divs = this->flat_geo_divs();
   double sum_target_area = 0.0;
   double sum_cart_area = 0.0;
 
-#pragma omp parallel for default(none) reduction(+ : sum_target_area, sum_cart_area)
-  for (const auto &gd : geo_divs_) {
-    sum_target_area += target_area_at(gd.id());
-    sum_cart_area += gd.area();
+#pragma omp parallel for default(none) shared(flat_geo_divs) \
+  reduction(+ : sum_target_area, sum_cart_area)
+  for (std::size_t gd_index = 0; gd_index < geo_divs_.size(); ++gd_index) {
+    sum_target_area += target_areas_[geo_divs_[gd_index].id_index()];
+    sum_cart_area += flat_geo_divs.area(gd_index);
   }
-  for (const auto &gd : geo_divs_) {
+  for (std::size_t gd_index = 0; gd_index < geo_divs_.size(); ++gd_index) {
+    const unsigned int id_index = geo_divs_[gd_index].id_index();
     const double obj_area =
-      target_area_at(gd.id()) * sum_cart_area / sum_target_area;
-    area_errors_[gd.id()] = std::abs((gd.area() / obj_area) - 1);
+      target_areas_[id_index] * sum_cart_area / sum_target_area;
+    area_errors_[id_index] =
+      std::abs((flat_geo_divs.area(gd_index) / obj_area) - 1);
   }
 }
 
@@ -424,6 +472,12 @@ void InsetState::set_inset_name(const std::string &inset_name)
   inset_name_ = inset_name;
 }
 
+void InsetState::set_integration_workspace(
+  std::shared_ptr<IntegrationWorkspace> integration_workspace)
+{
+  integration_workspace_ = std::move(integration_workspace);
+}
+
 void InsetState::store_initial_area()
 {
   initial_area_ = total_inset_area();
@@ -432,19 +486,21 @@ void InsetState::store_initial_area()
 bool InsetState::target_area_is_missing(const std::string &id) const
 {
   // We use negative area as indication that GeoDiv has no target area
-  return target_areas_.at(id) < 0.0;
+  return target_areas_[id_index(id)] < 0.0;
 }
 
 double InsetState::target_area_at(const std::string &id) const
 {
-  return target_areas_.at(id);
+  return target_areas_[id_index(id)];
 }
 
 double InsetState::total_inset_area() const
 {
+  const FlatGeometry &flat_geo_divs = this->flat_geo_divs();
   double total_inset_area = 0.0;
-  for (const auto &gd : geo_divs_) {
-    total_inset_area += gd.area();
+  for (std::size_t gd_index = 0; gd_index < flat_geo_divs.n_geo_divs();
+       ++gd_index) {
+    total_inset_area += flat_geo_divs.area(gd_index);
   }
   return total_inset_area;
 }
@@ -452,59 +508,55 @@ double InsetState::total_inset_area() const
 double InsetState::total_target_area() const
 {
   double inset_total_target_area = 0;
-  for (const auto &geo_div_target_area : target_areas_) {
-    inset_total_target_area += geo_div_target_area.second;
+  for (const double target_area : target_areas_) {
+    inset_total_target_area += target_area;
   }
   return inset_total_target_area;
 }
 
 std::string InsetState::label_at(const std::string &id) const
 {
-  if (labels_.find(id) == labels_.end()) {
+  const auto it = id_indices_.find(id);
+  if (it == id_indices_.end()) {
     return "";
   }
-  return labels_.at(id);
+  return labels_[it->second];
 }
 
 void InsetState::store_original_geo_divs()
 {
-  geo_divs_original_ = geo_divs_;
+  sync_geo_divs();
+  *ref_to_geo_divs(true) = geo_divs_;
+  sync_flat_geo_divs(true);
+}
+
+void InsetState::sync_flat_geo_divs(const bool original)
+{
+  FlatGeometry &flat_geo_divs =
+    original ? flat_geo_divs_original_ : flat_geo_divs_;
+  UpToDate &up_to_date = original ? up_to_date_original_ : up_to_date_;
+  if (up_to_date == UpToDate::geo_divs) {
+    flat_geo_divs.assign(original ? geo_divs_original_ : geo_divs_);
+    up_to_date = UpToDate::both;
+  }
+  flat_geo_divs.update_areas_and_bboxes();
+}
+
+void InsetState::sync_geo_divs(const bool original)
+{
+  UpToDate &up_to_date = original ? up_to_date_original_ : up_to_date_;
+  if (up_to_date == UpToDate::flat_geo_divs) {
+    (original ? flat_geo_divs_original_ : flat_geo_divs_)
+      .write_to(original ? geo_divs_original_ : geo_divs_);
+    up_to_date = UpToDate::both;
+  }
 }
 
 void InsetState::transform_points(
   const std::function<Point(Point)> &transform_point,
   bool project_original)
 {
-
-  auto &geo_divs = project_original ? geo_divs_original_ : geo_divs_;
-
-  // Iterate over GeoDivs
-#pragma omp parallel for default(none) shared(transform_point, geo_divs)
-  for (auto &gd : geo_divs) {
-
-    // Iterate over Polygon_with_holes
-    for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
-
-      // Get outer boundary
-      auto &outer_boundary = *(&pwh.outer_boundary());
-
-      // Iterate over outer boundary's coordinates
-      for (auto &coords_outer : outer_boundary) {
-
-        // Assign outer boundary's coordinates to transformed coordinates
-        coords_outer = transform_point(coords_outer);
-      }
-
-      // Iterate over holes
-      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
-
-        // Iterate over hole's coordinates
-        for (auto &coords_hole : *h) {
-
-          // Assign hole's coordinates to transformed coordinates
-          coords_hole = transform_point(coords_hole);
-        }
-      }
-    }
-  }
+  transform_points<std::function<Point(Point)> >(
+    transform_point,
+    project_original);
 }
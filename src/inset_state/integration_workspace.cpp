@@ -0,0 +1,122 @@
+#include "integration_workspace.h"
+#include <algorithm>
+
+IntegrationWorkspace::IntegrationWorkspace(
+  const unsigned int fftw_planner_flag)
+    : fftw_planner_flag_(fftw_planner_flag)
+{
+}
+
+IntegrationWorkspace::~IntegrationWorkspace()
+{
+  free_flux();
+}
+
+void IntegrationWorkspace::free_flux()
+{
+  if (lx_ == 0 || ly_ == 0) {
+    return;
+  }
+  grid_fluxx_init_.destroy_fftw_plan();
+  grid_fluxy_init_.destroy_fftw_plan();
+  grid_fluxx_init_.free();
+  grid_fluxy_init_.free();
+  lx_ = 0;
+  ly_ = 0;
+}
+
+IntegrationBuffers IntegrationWorkspace::integration_buffers(
+  const std::size_t n)
+{
+  if (velocities_.size() < n) {
+    const std::size_t n_tiles =
+      (n + integration_tile_size - 1) / integration_tile_size;
+    velocities_.resize(n);
+    proposals_.resize(n);
+    proposal_velocities_.resize(n);
+    tile_delta_t_.resize(n_tiles);
+    tile_stats_.resize(n_tiles);
+    update_peak_memory();
+  }
+  return {
+    velocities_.data(),
+    proposals_.data(),
+    proposal_velocities_.data(),
+    tile_delta_t_.data(),
+    tile_stats_.data()};
+}
+
+std::size_t IntegrationWorkspace::memory() const
+{
+  const std::size_t n_flux = 2 * static_cast<std::size_t>(lx_) * ly_;
+  const std::size_t n_xy_points =
+    points_.capacity() + velocities_.capacity() + proposals_.capacity() +
+    proposal_velocities_.capacity();
+  return n_flux * sizeof(double) + velocity_field_.memory() +
+         displacement_.memory() +
+         n_xy_points * sizeof(XYPoint) +
+         tile_delta_t_.capacity() * sizeof(double) +
+         tile_stats_.capacity() * sizeof(IntegrationStats);
+}
+
+std::size_t IntegrationWorkspace::peak_memory() const
+{
+  return peak_memory_;
+}
+
+BilinearInterpolator *IntegrationWorkspace::ref_to_displacement()
+{
+  return &displacement_;
+}
+
+FTReal2d *IntegrationWorkspace::ref_to_grid_fluxx_init()
+{
+  return &grid_fluxx_init_;
+}
+
+FTReal2d *IntegrationWorkspace::ref_to_grid_fluxy_init()
+{
+  return &grid_fluxy_init_;
+}
+
+std::vector<XYPoint> *IntegrationWorkspace::ref_to_points(const std::size_t n)
+{
+  points_.resize(n);
+  update_peak_memory();
+  return &points_;
+}
+
+VelocityField *IntegrationWorkspace::ref_to_velocity_field()
+{
+  return &velocity_field_;
+}
+
+void IntegrationWorkspace::set_grid_dimensions(
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  if (lx == lx_ && ly == ly_) {
+    return;
+  }
+  free_flux();
+  lx_ = lx;
+  ly_ = ly;
+  grid_fluxx_init_.allocate(lx, ly);
+  grid_fluxy_init_.allocate(lx, ly);
+  grid_fluxx_init_.make_fftw_plan(
+    FFTW_RODFT01,
+    FFTW_REDFT01,
+    fftw_planner_flag_);
+  grid_fluxy_init_.make_fftw_plan(
+    FFTW_REDFT01,
+    FFTW_RODFT01,
+    fftw_planner_flag_);
+  velocity_field_.set_grid_dimensions(lx, ly);
+  displacement_.set_grid_dimensions(lx, ly);
+  update_peak_memory();
+}
+
+void IntegrationWorkspace::update_peak_memory()
+{
+  peak_memory_ = std::max(peak_memory_, memory());
+}
@@ -0,0 +1,580 @@
+#include "integrator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+// In multi-rate mode, all tiles reach the times 1/n, 2/n, ..., 1 together,
+// where n is the following constant
+constexpr unsigned int multi_rate_n_sync_times = 4;
+
+// Function to evaluate the velocity at time t at all n points in pts,
+// tile by tile
+static void velocity_at_points(
+  const VelocityField &velocity_field,
+  const double t,
+  const XYPoint *pts,
+  XYPoint *v,
+  const std::size_t n)
+{
+  const std::size_t n_tiles =
+    (n + integration_tile_size - 1) / integration_tile_size;
+
+#pragma omp parallel for if (n_tiles > 1) default(none) \
+  shared(integration_tile_size, n, n_tiles, pts, t, v, velocity_field)
+  for (std::size_t tile = 0; tile < n_tiles; ++tile) {
+    const std::size_t begin = tile * integration_tile_size;
+    velocity_field.velocity(
+      t,
+      pts + begin,
+      v + begin,
+      std::min(integration_tile_size, n - begin));
+  }
+}
+
+static bool is_in_domain(
+  const XYPoint &p,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  return !(p.x < 0.0 || p.x > lx || p.y < 0.0 || p.y > ly);
+}
+
+Integrator::Integrator(const bool multi_rate) : multi_rate_(multi_rate) {}
+
+IntegrationStats Integrator::integrate(
+  const VelocityField &velocity_field,
+  XYPoint *pts,
+  const std::size_t n,
+  const IntegrationBuffers &buffers,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double abs_tol) const
+{
+  const auto start = std::chrono::steady_clock::now();
+  IntegrationStats stats;
+  const double initial_delta_t = 1e-2;
+
+  // v[k] will be the velocity at position pts[k] at the current time
+  XYPoint *v = buffers.velocities;
+  velocity_at_points(velocity_field, 0.0, pts, v, n);
+  ++stats.n_velocity_evaluations;
+  if (!multi_rate_) {
+    double delta_t = initial_delta_t;
+    advance(
+      velocity_field,
+      pts,
+      v,
+      buffers.proposals,
+      buffers.proposal_velocities,
+      n,
+      0.0,
+      1.0,
+      delta_t,
+      lx,
+      ly,
+      abs_tol,
+      stats,
+      true);
+  } else {
+
+    // Each tile keeps its own step size and statistics between the
+    // synchronization times. Because the work per tile varies strongly, the
+    // tiles are scheduled dynamically.
+    const std::size_t n_tiles =
+      (n + integration_tile_size - 1) / integration_tile_size;
+    double *tile_delta_t = buffers.tile_delta_t;
+    IntegrationStats *tile_stats = buffers.tile_stats;
+    std::fill(tile_delta_t, tile_delta_t + n_tiles, initial_delta_t);
+    std::fill(tile_stats, tile_stats + n_tiles, IntegrationStats());
+    for (unsigned int sync = 1; sync <= multi_rate_n_sync_times; ++sync) {
+      const double t_begin = (sync - 1.0) / multi_rate_n_sync_times;
+      const double t_end = static_cast<double>(sync) / multi_rate_n_sync_times;
+
+#pragma omp parallel for schedule(dynamic) default(none) shared( \
+  abs_tol,                                                        \
+  buffers,                                                        \
+  integration_tile_size,                                          \
+  lx,                                                             \
+  ly,                                                             \
+  n,                                                              \
+  n_tiles,                                                        \
+  pts,                                                            \
+  t_begin,                                                        \
+  t_end,                                                          \
+  tile_delta_t,                                                   \
+  tile_stats,                                                     \
+  v,                                                              \
+  velocity_field)
+      for (std::size_t tile = 0; tile < n_tiles; ++tile) {
+        const std::size_t begin = tile * integration_tile_size;
+        advance(
+          velocity_field,
+          pts + begin,
+          v + begin,
+          buffers.proposals + begin,
+          buffers.proposal_velocities + begin,
+          std::min(integration_tile_size, n - begin),
+          t_begin,
+          t_end,
+          tile_delta_t[tile],
+          lx,
+          ly,
+          abs_tol,
+          tile_stats[tile],
+          false);
+      }
+
+      // Control output
+      const IntegrationStats *busiest = std::max_element(
+        tile_stats,
+        tile_stats + n_tiles,
+        [](const IntegrationStats &a, const IntegrationStats &b) {
+          return a.n_steps < b.n_steps;
+        });
+      std::cerr << "t = " << t_end << ", steps in busiest tile = "
+                << busiest->n_steps << ", smallest delta_t = "
+                << *std::min_element(tile_delta_t, tile_delta_t + n_tiles)
+                << "\n";
+    }
+
+    // Combine the statistics of the tiles
+    for (std::size_t tile = 0; tile < n_tiles; ++tile) {
+      const std::size_t m =
+        std::min(integration_tile_size, n - tile * integration_tile_size);
+      if (tile_stats[tile].n_steps > stats.n_steps) {
+        stats.n_steps = tile_stats[tile].n_steps;
+        stats.n_rejected_steps = tile_stats[tile].n_rejected_steps;
+      }
+      stats.n_velocity_evaluations +=
+        tile_stats[tile].n_velocity_evaluations * m / n;
+    }
+  }
+  stats.wall_time_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  return stats;
+}
+
+bool Integrator::multi_rate() const
+{
+  return multi_rate_;
+}
+
+// Function to attempt one step of the explicit midpoint method
+// x <- x + delta_t * v_x(x + 0.5*delta_t*v_x(x,y,t),
+//                        y + 0.5*delta_t*v_y(x,y,t),
+//                        t + 0.5*delta_t)
+// and similarly for y, for all n points in proj. v_intp must contain the
+// velocity at proj at time t. The proposed positions are written to mid. The
+// Euler proposal proj + delta_t*v_intp, the error norm and the domain checks
+// are computed in the same pass, so that no other full-grid arrays are
+// needed. Return false if the step must be rejected.
+static bool midpoint_step(
+  const double t,
+  const double delta_t,
+  const XYPoint *proj,
+  const XYPoint *v_intp,
+  const VelocityField &velocity_field,
+  XYPoint *mid,
+  const std::size_t n,
+  const double abs_tol,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  const std::size_t n_tiles =
+    (n + integration_tile_size - 1) / integration_tile_size;
+  bool accept = true;
+
+#pragma omp parallel for if (n_tiles > 1) reduction(&&:accept) \
+  default(none) shared(                                             \
+  abs_tol,                                                           \
+  delta_t,                                                           \
+  integration_tile_size,                                             \
+  lx,                                                                \
+  ly,                                                                \
+  mid,                                                               \
+  n,                                                                 \
+  n_tiles,                                                           \
+  proj,                                                              \
+  t,                                                                 \
+  v_intp,                                                            \
+  velocity_field)
+  for (std::size_t tile = 0; tile < n_tiles; ++tile) {
+
+    // There is no need to work on this tile if the thread has already
+    // rejected the step
+    if (!accept) {
+      continue;
+    }
+    const std::size_t begin = tile * integration_tile_size;
+    const std::size_t m = std::min(integration_tile_size, n - begin);
+    XYPoint half_step[integration_tile_size];
+    XYPoint v_intp_half[integration_tile_size];
+
+    // Make sure we do not pass a point outside [0, lx] x [0, ly] to the
+    // interpolation
+    bool in_domain = true;
+    for (std::size_t k = 0; k < m; ++k) {
+      const XYPoint &p = proj[begin + k];
+      const XYPoint &v = v_intp[begin + k];
+      half_step[k].x = p.x + 0.5 * delta_t * v.x;
+      half_step[k].y = p.y + 0.5 * delta_t * v.y;
+      in_domain = in_domain && is_in_domain(half_step[k], lx, ly);
+    }
+    if (!in_domain) {
+      accept = false;
+      continue;
+    }
+    velocity_field.velocity(t + 0.5 * delta_t, half_step, v_intp_half, m);
+    for (std::size_t k = 0; k < m; ++k) {
+      const XYPoint &p = proj[begin + k];
+      const XYPoint &v = v_intp[begin + k];
+      XYPoint &q = mid[begin + k];
+      q.x = p.x + v_intp_half[k].x * delta_t;
+      q.y = p.y + v_intp_half[k].y * delta_t;
+
+      // Do not accept the integration step if the maximum squared
+      // difference between the Euler and midpoint proposals exceeds
+      // abs_tol. Neither should we accept the integration step if one of
+      // the positions wandered out of the domain.
+      const double eul_x = p.x + v.x * delta_t;
+      const double eul_y = p.y + v.y * delta_t;
+      const double sq_dist =
+        (q.x - eul_x) * (q.x - eul_x) + (q.y - eul_y) * (q.y - eul_y);
+      accept = accept && !(sq_dist > abs_tol) && is_in_domain(q, lx, ly);
+    }
+  }
+  return accept;
+}
+
+void MidpointIntegrator::advance(
+  const VelocityField &velocity_field,
+  XYPoint *pts,
+  XYPoint *v_intp,
+  XYPoint *next,
+  XYPoint *,
+  const std::size_t n,
+  const double t_begin,
+  const double t_end,
+  double &delta_t,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double abs_tol,
+  IntegrationStats &stats,
+  const bool print_progress) const
+{
+  // Constants for the step-size control
+  const double inc_after_acc = 1.1;
+  const double dec_after_not_acc = 0.75;
+
+  // The midpoint method proposes new positions in a second buffer. After an
+  // accepted step, we swap the roles of the two buffers instead of copying.
+  XYPoint *proj = pts;
+  XYPoint *mid = next;
+  double t = t_begin;
+  while (t < t_end) {
+
+    // We know, either because of the initialization or because of the
+    // check at the end of the last iteration, that proj[k] is inside the
+    // rectangle [0, lx] x [0, ly]. This fact guarantees that the
+    // interpolation is given points that cannot cause it to fail.
+    bool accept = false;
+    bool last_step = false;
+    double h = delta_t;
+    while (!accept) {
+
+      // Do not step beyond t_end
+      last_step = (t + delta_t >= t_end);
+      h = last_step ? t_end - t : delta_t;
+      accept = midpoint_step(
+        t,
+        h,
+        proj,
+        v_intp,
+        velocity_field,
+        mid,
+        n,
+        abs_tol,
+        lx,
+        ly);
+      ++stats.n_velocity_evaluations;
+      if (!accept) {
+        ++stats.n_rejected_steps;
+        delta_t = h * dec_after_not_acc;
+      }
+    }
+
+    // Control ouput
+    if (print_progress && stats.n_steps % 10 == 0) {
+      std::cerr << "iter = " << stats.n_steps << ", t = " << t
+                << ", delta_t = " << h << "\n";
+    }
+
+    // When we get here, the integration step was accepted
+    t = last_step ? t_end : t + h;
+    ++stats.n_steps;
+    std::swap(proj, mid);
+    if (!last_step) {
+      delta_t *= inc_after_acc;  // Try a larger step next time
+    }
+    velocity_at_points(velocity_field, t, proj, v_intp, n);
+    ++stats.n_velocity_evaluations;
+  }
+
+  // The final positions may be in the second buffer
+  if (proj != pts) {
+    std::copy(proj, proj + n, pts);
+  }
+}
+
+std::string_view MidpointIntegrator::name() const
+{
+  return "midpoint";
+}
+
+// Butcher tableau of the Dormand-Prince 5(4) pair. The weights of the
+// fifth-order solution are equal to the last row of dp_a, so that the
+// seventh stage is the velocity at the new position. dp_e holds the
+// differences between the fifth- and fourth-order weights.
+constexpr unsigned int dp_n_stages = 7;
+constexpr double dp_c[dp_n_stages] =
+  {0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0, 1.0};
+constexpr double dp_a[dp_n_stages][dp_n_stages - 1] = {
+  {},
+  {1.0 / 5.0},
+  {3.0 / 40.0, 9.0 / 40.0},
+  {44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0},
+  {19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0},
+  {9017.0 / 3168.0,
+   -355.0 / 33.0,
+   46732.0 / 5247.0,
+   49.0 / 176.0,
+   -5103.0 / 18656.0},
+  {35.0 / 384.0,
+   0.0,
+   500.0 / 1113.0,
+   125.0 / 192.0,
+   -2187.0 / 6784.0,
+   11.0 / 84.0}};
+constexpr double dp_e[dp_n_stages] = {
+  71.0 / 57600.0,
+  0.0,
+  -71.0 / 16695.0,
+  71.0 / 1920.0,
+  -17253.0 / 339200.0,
+  22.0 / 525.0,
+  -1.0 / 40.0};
+
+// Result of an attempted Dormand-Prince step
+struct DormandPrinceTrial {
+  bool in_domain;
+
+  // Maximum squared distance between the fifth- and fourth-order solutions
+  double max_sq_error;
+};
+
+// Function to attempt one Dormand-Prince step for all n points in proj.
+// v_intp must contain the velocity at proj at time t. The fifth-order
+// solution is written to next and the velocity at next at time t + delta_t
+// to v_next. All stages of a tile are computed before moving to the next
+// tile.
+static DormandPrinceTrial dormand_prince_step(
+  const double t,
+  const double delta_t,
+  const XYPoint *proj,
+  const XYPoint *v_intp,
+  const VelocityField &velocity_field,
+  XYPoint *next,
+  XYPoint *v_next,
+  const std::size_t n,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  const std::size_t n_tiles =
+    (n + integration_tile_size - 1) / integration_tile_size;
+  bool in_domain = true;
+  double max_sq_error = 0.0;
+
+#pragma omp parallel for if (n_tiles > 1) reduction(&&:in_domain)        \
+  reduction(max:max_sq_error) default(none)                                  \
+  shared(delta_t, dp_a, dp_c, dp_e, dp_n_stages, integration_tile_size, lx,  \
+         ly, n, n_tiles, next, proj, t, v_intp, v_next, velocity_field)
+  for (std::size_t tile = 0; tile < n_tiles; ++tile) {
+    if (!in_domain) {
+      continue;
+    }
+    const std::size_t begin = tile * integration_tile_size;
+    const std::size_t m = std::min(integration_tile_size, n - begin);
+
+    // Velocities at the stages. The first and the last stage are stored in
+    // v_intp and v_next, the others in local arrays.
+    XYPoint k_local[dp_n_stages - 2][integration_tile_size];
+    const XYPoint *k[dp_n_stages];
+    k[0] = v_intp + begin;
+    XYPoint stage_pts[integration_tile_size];
+    for (unsigned int s = 1; s < dp_n_stages; ++s) {
+      const bool last_stage = (s == dp_n_stages - 1);
+      XYPoint *k_s = last_stage ? v_next + begin : k_local[s - 1];
+
+      // The position of the last stage is the fifth-order solution
+      XYPoint *y = last_stage ? next + begin : stage_pts;
+      for (std::size_t i = 0; i < m; ++i) {
+        XYPoint dy(0.0, 0.0);
+        for (unsigned int j = 0; j < s; ++j) {
+          dy.x += dp_a[s][j] * k[j][i].x;
+          dy.y += dp_a[s][j] * k[j][i].y;
+        }
+        y[i].x = proj[begin + i].x + delta_t * dy.x;
+        y[i].y = proj[begin + i].y + delta_t * dy.y;
+        in_domain = in_domain && is_in_domain(y[i], lx, ly);
+      }
+      if (!in_domain) {
+        break;
+      }
+      velocity_field.velocity(t + dp_c[s] * delta_t, y, k_s, m);
+      k[s] = k_s;
+    }
+    if (!in_domain) {
+      continue;
+    }
+    for (std::size_t i = 0; i < m; ++i) {
+      XYPoint err(0.0, 0.0);
+      for (unsigned int s = 0; s < dp_n_stages; ++s) {
+        err.x += dp_e[s] * k[s][i].x;
+        err.y += dp_e[s] * k[s][i].y;
+      }
+      max_sq_error = std::max(
+        max_sq_error,
+        delta_t * delta_t * (err.x * err.x + err.y * err.y));
+    }
+  }
+  return {in_domain, max_sq_error};
+}
+
+void DormandPrinceIntegrator::advance(
+  const VelocityField &velocity_field,
+  XYPoint *pts,
+  XYPoint *v,
+  XYPoint *next,
+  XYPoint *v_next,
+  const std::size_t n,
+  const double t_begin,
+  const double t_end,
+  double &delta_t,
+  const unsigned int lx,
+  const unsigned int ly,
+  const double abs_tol,
+  IntegrationStats &stats,
+  const bool print_progress) const
+{
+  // Constants for the step-size control. The step size is multiplied by
+  // safety * (tolerance / error)^(1/5), bounded by min_factor and
+  // max_factor. If a stage leaves the domain, there is no error estimate,
+  // and the step size is multiplied by dec_outside_domain.
+  const double safety = 0.9;
+  const double min_factor = 0.2;
+  const double max_factor = 5.0;
+  const double dec_outside_domain = 0.5;
+
+  // As in the midpoint method, the new positions are proposed in a second
+  // buffer, and the buffers are swapped after an accepted step. The same
+  // holds for the velocities at the old and new positions.
+  XYPoint *proj = pts;
+  XYPoint *v_intp = v;
+  double t = t_begin;
+  while (t < t_end) {
+    bool accept = false;
+    while (!accept) {
+
+      // Do not step beyond t_end
+      const bool last_step = (t + delta_t >= t_end);
+      const double h = last_step ? t_end - t : delta_t;
+      const DormandPrinceTrial trial = dormand_prince_step(
+        t,
+        h,
+        proj,
+        v_intp,
+        velocity_field,
+        next,
+        v_next,
+        n,
+        lx,
+        ly);
+      stats.n_velocity_evaluations += dp_n_stages - 1;
+      if (!trial.in_domain) {
+        ++stats.n_rejected_steps;
+        delta_t = h * dec_outside_domain;
+        continue;
+      }
+
+      // Error relative to the tolerance. The tolerance applies to the
+      // squared distance, as in the midpoint method.
+      const double err_ratio = std::sqrt(trial.max_sq_error / abs_tol);
+      accept = (err_ratio <= 1.0);
+      double factor =
+        (err_ratio > 0.0) ? safety * std::pow(err_ratio, -0.2) : max_factor;
+      factor = std::clamp(factor, min_factor, accept ? max_factor : 1.0);
+      if (!accept) {
+        ++stats.n_rejected_steps;
+        delta_t = h * factor;
+        continue;
+      }
+
+      // Control ouput
+      if (print_progress && stats.n_steps % 10 == 0) {
+        std::cerr << "iter = " << stats.n_steps << ", t = " << t
+                  << ", delta_t = " << h << "\n";
+      }
+      t = last_step ? t_end : t + h;
+
+      // A step that was shortened to reach t_end says little about the
+      // step size that the next interval can afford
+      delta_t = last_step ? std::max(delta_t, h * factor) : h * factor;
+    }
+    ++stats.n_steps;
+    std::swap(proj, next);
+    std::swap(v_intp, v_next);
+  }
+
+  // The final positions and velocities may be in the second buffers
+  if (proj != pts) {
+    std::copy(proj, proj + n, pts);
+    std::copy(v_intp, v_intp + n, v);
+  }
+}
+
+std::string_view DormandPrinceIntegrator::name() const
+{
+  return "Dormand-Prince 5(4)";
+}
+
+std::unique_ptr<Integrator> make_integrator(
+  const IntegrationMethod method,
+  const bool multi_rate)
+{
+  switch (method) {
+  case IntegrationMethod::dormand_prince:
+    return std::make_unique<DormandPrinceIntegrator>(multi_rate);
+  case IntegrationMethod::midpoint:
+  default:
+    return std::make_unique<MidpointIntegrator>(multi_rate);
+  }
+}
+
+// Function to report the number of accepted and rejected steps, the number
+// of velocity evaluations and the wall-clock time of an integration
+void print_integration_stats(
+  const Integrator &integrator,
+  const IntegrationStats &stats)
+{
+  std::cerr << "Integrator " << integrator.name()
+            << (integrator.multi_rate() ? " (multi-rate)" : "") << ": "
+            << stats.n_steps
+            << " steps, " << stats.n_rejected_steps << " rejected, "
+            << stats.n_velocity_evaluations << " velocity evaluations, "
+            << stats.wall_time_ms << " ms, "
+            << (stats.n_steps > 0 ? stats.wall_time_ms / stats.n_steps : 0.0)
+            << " ms per step" << std::endl;
+}
@@ -0,0 +1,146 @@
+#include "bilinear_interpolator.h"
+#include "constants.h"
+#include "fftw_threads.h"
+#include "inset_state.h"
+#include "integration_workspace.h"
+#include <iostream>
+
+// Function to store the flux and the initial density, from which the
+// velocity field at any time t is calculated on demand. The dimensions of
+// velocity_field must already be lx and ly.
+static void store_flux_and_density(
+  FTReal2d &grid_fluxx_init,
+  FTReal2d &grid_fluxy_init,
+  FTReal2d &rho_ft,
+  FTReal2d &rho_init,
+  VelocityField *velocity_field,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  velocity_field->set_rho_ft_00(rho_ft(0, 0));
+#pragma omp parallel for default(none) shared( \
+  grid_fluxx_init,                             \
+  grid_fluxy_init,                             \
+  velocity_field,                              \
+  lx,                                          \
+  ly,                                          \
+  rho_init)
+  for (unsigned int i = 0; i < lx; ++i) {
+    for (unsigned int j = 0; j < ly; ++j) {
+      velocity_field->set_values(
+        i,
+        j,
+        grid_fluxx_init(i, j),
+        grid_fluxy_init(i, j),
+        rho_init(i, j));
+    }
+  }
+  velocity_field->pad_boundaries();
+}
+
+// Function to compute the velocity field for flatten_density() and
+// flatten_density_with_node_vertices() from the Fourier transform of the
+// density, rho_ft_, which fill_with_density() has computed.
+// All work on the Fourier coefficients happens in a single pass over rho_ft_:
+// the Gaussian blur, the normalization of the transform and the Fourier
+// coefficients of both flux components. Previously, the blur, the x-flux and
+// the y-flux each needed their own pass over the lx_-times-ly_ grid. The
+// blurred density, the x-flux and the y-flux are then transformed back to
+// real space. These three transforms are independent of each other. The
+// backward transform of the density is skipped if blur_width is 0 because
+// rho_init_ then still holds the density in real space.
+void InsetState::prepare_velocity_field(
+  const double blur_width,
+  const bool plot_density)
+{
+  // Fourier transforms for the flux. The arrays and FFTW plans are reused
+  // from the previous integration if the grid dimensions are unchanged.
+  integration_workspace_->set_grid_dimensions(lx_, ly_);
+  FTReal2d &grid_fluxx_init =
+    *integration_workspace_->ref_to_grid_fluxx_init();
+  FTReal2d &grid_fluxy_init =
+    *integration_workspace_->ref_to_grid_fluxy_init();
+
+  // We must typecast lx_ and ly_ as double-precision numbers. Otherwise, the
+  // ratios in the denominators below will evaluate as zero.
+  const double dlx = lx_;
+  const double dly = ly_;
+  const double prefactor = -0.5 * blur_width * blur_width * pi * pi;
+
+  // The Fourier coefficient of the x-flux at (i - 1, j) only depends on the
+  // blurred rho_ft_(i, j), and the coefficient of the y-flux at (i, j - 1)
+  // only depends on the blurred rho_ft_(i, j). Hence, both can be written as
+  // soon as rho_ft_(i, j) is blurred. The reason for `+1` in the flux indices
+  // stems from the RODFT10 formula at:
+  // https://www.fftw.org/fftw3_doc/1d-Real_002dodd-DFTs-_0028DSTs_0029.html
+  // The highest x-flux and y-flux frequencies have no source and are zero.
+#pragma omp parallel for default(none) \
+  shared(grid_fluxx_init, grid_fluxy_init, dlx, dly, prefactor)
+  for (unsigned int i = 0; i < lx_; ++i) {
+    const double di = i;
+    const double scaled_i = di / lx_;
+    const double scaled_i_squared = scaled_i * scaled_i;
+    for (unsigned int j = 0; j < ly_; ++j) {
+      const double scaled_j = static_cast<double>(j) / ly_;
+      const double scaled_j_squared = scaled_j * scaled_j;
+      rho_ft_(i, j) *= exp(prefactor * (scaled_i_squared + scaled_j_squared)) /
+                       (4 * lx_ * ly_);
+      if (i > 0) {
+        const double denom =
+          pi * (di / dlx + (j / di) * (j / dly) * (dlx / dly));
+        grid_fluxx_init(i - 1, j) = -rho_ft_(i, j) / denom;
+      }
+      if (j > 0) {
+        const double denom =
+          pi * ((di / j) * (di / dlx) * (dly / dlx) + j / dly);
+        grid_fluxy_init(i, j - 1) = -rho_ft_(i, j) / denom;
+      }
+    }
+    grid_fluxy_init(i, ly_ - 1) = 0.0;
+  }
+  for (unsigned int j = 0; j < ly_; ++j) {
+    grid_fluxx_init(lx_ - 1, j) = 0.0;
+  }
+
+  // Transform the flux and the blurred density back to real space. If FFTW
+  // uses several threads per transform, the transforms run one after the
+  // other. Otherwise, they run concurrently. fftw_execute() is thread-safe
+  // as long as the plans do not share arrays.
+  const bool blurred = (blur_width > 0.0);
+  if (fftw_is_multithreaded()) {
+    grid_fluxx_init.execute_fftw_plan();
+    grid_fluxy_init.execute_fftw_plan();
+    if (blurred) {
+      execute_fftw_bwd_plan();
+    }
+  } else {
+#pragma omp parallel sections default(none) \
+  shared(grid_fluxx_init, grid_fluxy_init, blurred)
+    {
+#pragma omp section
+      grid_fluxx_init.execute_fftw_plan();
+#pragma omp section
+      grid_fluxy_init.execute_fftw_plan();
+#pragma omp section
+      if (blurred) {
+        execute_fftw_bwd_plan();
+      }
+    }
+  }
+  if (plot_density && blurred) {
+    std::string file_name = inset_name_ + "_blurred_density_" +
+                            std::to_string(n_finished_integrations_) + ".eps";
+    std::cerr << "Writing " << file_name << std::endl;
+    write_density_to_eps(file_name, rho_init_.as_1d_array());
+  }
+
+  // The velocity field only needs the flux and the density
+  store_flux_and_density(
+    grid_fluxx_init,
+    grid_fluxy_init,
+    rho_ft_,
+    rho_init_,
+    integration_workspace_->ref_to_velocity_field(),
+    lx_,
+    ly_);
+}
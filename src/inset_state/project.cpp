@@ -1,84 +1,77 @@
-#include "interpolate_bilinearly.h"
+#include "bilinear_interpolator.h"
+#include "delaunay_locator.h"
 #include "matrix.h"
 #include "round_point.h"
+#include <algorithm>
+#include <array>
 #include <boost/multi_array.hpp>
 #include <iostream>
-
-Point interpolate_point_bilinearly(
-  const Point p1,
-  const boost::multi_array<double, 2> *xdisp,
-  const boost::multi_array<double, 2> *ydisp,
-  const unsigned int lx,
-  const unsigned int ly)
-{
-  const double intp_x =
-    interpolate_bilinearly(p1.x(), p1.y(), xdisp, 'x', lx, ly);
-  const double intp_y =
-    interpolate_bilinearly(p1.x(), p1.y(), ydisp, 'y', lx, ly);
-  return {p1.x() + intp_x, p1.y() + intp_y};
-}
+#include <numeric>
 
 void InsetState::project()
 {
-  // Calculate displacement from proj array
-  boost::multi_array<double, 2> xdisp(boost::extents[lx_][ly_]);
-  boost::multi_array<double, 2> ydisp(boost::extents[lx_][ly_]);
+  // Calculate displacement from proj array. The interpolator belongs to the
+  // integration workspace, which prepare_velocity_field() has sized for the
+  // grid, so that no memory is allocated here.
+  BilinearInterpolator &disp = *integration_workspace_->ref_to_displacement();
 
-#pragma omp parallel for default(none) shared(xdisp, ydisp)
+#pragma omp parallel for default(none) shared(disp)
   for (unsigned int i = 0; i < lx_; ++i) {
     for (unsigned int j = 0; j < ly_; ++j) {
-      xdisp[i][j] = proj_[i][j].x - i - 0.5;
-      ydisp[i][j] = proj_[i][j].y - j - 0.5;
+      disp.set_values(i, j, proj_[i][j].x - i - 0.5, proj_[i][j].y - j - 0.5);
     }
   }
+  disp.pad_boundaries();
+
+  // The points are interpolated in blocks so that the vectorized kernel of
+  // BilinearInterpolator can be used. Each thread keeps the displacements of
+  // one block on its stack.
+  constexpr std::size_t block_size = 256;
 
   // Cumulative projection
-#pragma omp parallel for default(none) shared(xdisp, ydisp)
+#pragma omp parallel for default(none) shared(disp, block_size)
   for (unsigned int i = 0; i < lx_; ++i) {
-    for (unsigned int j = 0; j < ly_; ++j) {
 
-      // TODO: Should the interpolation be made on the basis of triangulation?
-      // Calculate displacement for cumulative graticule coordinates
-      const double graticule_intp_x = interpolate_bilinearly(
-        cum_proj_[i][j].x,
-        cum_proj_[i][j].y,
-        &xdisp,
-        'x',
-        lx_,
-        ly_);
-      const double graticule_intp_y = interpolate_bilinearly(
-        cum_proj_[i][j].x,
-        cum_proj_[i][j].y,
-        &ydisp,
-        'y',
-        lx_,
-        ly_);
+    // TODO: Should the interpolation be made on the basis of
+    // triangulation?
+    std::array<XYPoint, block_size> graticule_intp;
+    for (unsigned int begin = 0; begin < ly_; begin += block_size) {
+      const unsigned int n =
+        std::min(static_cast<unsigned int>(block_size), ly_ - begin);
+      disp.interpolate(&cum_proj_[i][begin], graticule_intp.data(), n);
 
       // Update cumulative graticule coordinates
-      cum_proj_[i][j].x += graticule_intp_x;
-      cum_proj_[i][j].y += graticule_intp_y;
+      for (unsigned int j = 0; j < n; ++j) {
+        cum_proj_[i][begin + j].x += graticule_intp[j].x;
+        cum_proj_[i][begin + j].y += graticule_intp[j].y;
+      }
     }
   }
 
-  // Specialize (i.e., curry) interpolate_point_bilinearly() such that it only
-  // requires one argument (Point p1).
-  std::function<Point(Point)> lambda =
-    [&xdisp, &ydisp, lx = lx_, ly = ly_](Point p1) {
-      return interpolate_point_bilinearly(p1, &xdisp, &ydisp, lx, ly);
-    };
-
-  // Apply "lambda" to all points
-  transform_points(lambda);
+  // Displace each point by the interpolated displacement
+  std::vector<XYPoint> &points = *ref_to_flat_geo_divs()->ref_to_points();
+  const std::size_t n_points = points.size();
+#pragma omp parallel for default(none) \
+  shared(block_size, disp, n_points, points)
+  for (std::size_t begin = 0; begin < n_points; begin += block_size) {
+    std::array<XYPoint, block_size> displacements;
+    const std::size_t n = std::min(block_size, n_points - begin);
+    disp.interpolate(&points[begin], displacements.data(), n);
+    for (std::size_t k = 0; k < n; ++k) {
+      points[begin + k].x += displacements[k].x;
+      points[begin + k].y += displacements[k].y;
+    }
+  }
+  sync_flat_geo_divs();
 }
 
+// Interpolate the projection of the point p, which is inside the Delaunay
+// face fh, from the projections of the vertices of fh
 Point interpolate_point_with_barycentric_coordinates(
   const Point p,
-  const Delaunay &dt,
+  const Face_handle fh,
   const std::unordered_map<Point, Point> &proj_map)
 {
-  // Find the triangle containing the point
-  const Face_handle fh = dt.locate(p);
-
   // Get the three vertices
   const Point v1 = fh->vertex(0)->point();
   const Point v2 = fh->vertex(1)->point();
@@ -108,14 +101,69 @@ Point interpolate_point_with_barycentric_coordinates(
     bary_x * v1_proj.y() + bary_y * v2_proj.y() + bary_z * v3_proj.y()};
 }
 
-void InsetState::project_with_delaunay_t()
+// Project all points with the Delaunay triangulation of the current
+// integration. Each thread remembers the face in which it found the previous
+// point and starts the search for the next point from there. Consecutive
+// points on a ring are usually in the same or in a neighbouring face. With
+// DelaunayLocator::hilbert, the points are visited in the order of a Hilbert
+// curve instead of the order of the rings. With DelaunayLocator::cold, every
+// search starts from the same face.
+// If project_original is true, the original coordinates are projected
+// instead. Calling the function once per integration in this way composes
+// the projections of all integrations without storing their triangulations.
+void InsetState::project_with_delaunay_t(
+  const DelaunayLocator delaunay_locator,
+  const bool project_original)
 {
-  std::function<Point(Point)> lambda_bary =
-    [&dt = proj_qd_.dt,
-     &proj_map = proj_qd_.triangle_transformation](Point p1) {
-      return interpolate_point_with_barycentric_coordinates(p1, dt, proj_map);
-    };
-  transform_points(lambda_bary);
+  std::vector<XYPoint> &points =
+    *ref_to_flat_geo_divs(project_original)->ref_to_points();
+  const std::size_t n_points = points.size();
+  std::vector<std::size_t> order;
+  if (delaunay_locator == DelaunayLocator::hilbert) {
+    order = hilbert_order(points, lx_, ly_);
+  } else {
+    order.resize(n_points);
+    std::iota(order.begin(), order.end(), 0);
+  }
+  const bool use_hint = (delaunay_locator != DelaunayLocator::cold);
+  constexpr std::size_t chunk_size = 4096;
+  const std::size_t n_chunks = (n_points + chunk_size - 1) / chunk_size;
+  unsigned long n_steps = 0;
+#pragma omp parallel default(none) reduction(+ : n_steps) shared( \
+  points,                                                        \
+  order,                                                         \
+  use_hint,                                                      \
+  n_points,                                                      \
+  chunk_size,                                                    \
+  n_chunks)
+  {
+    Face_handle hint;
+#pragma omp for schedule(dynamic)
+    for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+      const std::size_t end = std::min(n_points, (chunk + 1) * chunk_size);
+      for (std::size_t k = chunk * chunk_size; k < end; ++k) {
+        XYPoint &point = points[order[k]];
+        const Point p(point.x, point.y);
+        const Face_handle fh = located_face(
+          proj_qd_.dt,
+          p,
+          use_hint ? hint : Face_handle(),
+          n_steps);
+        hint = fh;
+        const Point p_proj = interpolate_point_with_barycentric_coordinates(
+          p,
+          fh,
+          proj_qd_.triangle_transformation);
+        point = XYPoint(p_proj.x(), p_proj.y());
+      }
+    }
+  }
+  sync_flat_geo_divs(project_original);
+  if (n_points > 0) {
+    std::cerr << "Delaunay point location: "
+              << static_cast<double>(n_steps) / n_points << " steps per point"
+              << std::endl;
+  }
 }
 
 // In chosen_diag() and transformed_triangle(), the input x-coordinates can
@@ -149,6 +197,53 @@ Point InsetState::projected_point(const Point p1, const bool project_original)
     (p1.y() == 0.0 || p1.y() == ly_) ? p1.y() : proj[proj_x][proj_y].y};
 }
 
+// Twice the signed area of the triangle with corners (x0, y0), (x1, y1) and
+// (x2, y2). The result is positive if the corners are in counterclockwise
+// order and negative if they are in clockwise order.
+static inline double orientation(
+  const double x0,
+  const double y0,
+  const double x1,
+  const double y1,
+  const double x2,
+  const double y2)
+{
+  return (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+}
+
+// Diagonal of the quadrilateral with corners (x[0], y[0]), ..., (x[3], y[3])
+// that is inside the quadrilateral. The diagonal from corner 0 to corner 2 is
+// inside if the triangles (0, 1, 2) and (0, 2, 3) have the same orientation.
+// Analogously, the diagonal from corner 1 to corner 3 is inside if the
+// triangles (0, 1, 3) and (1, 2, 3) have the same orientation. If both are
+// inside, we prefer the diagonal from corner 0 to corner 2. The return value
+// is -1 if neither diagonal is inside. The quadrilateral is concave if the
+// turns at its corners do not all have the same direction. The function has
+// no branches that depend on the coordinates so that the compiler can
+// vectorize loops that call it.
+static inline int diag_inside_quadrilateral(
+  const double x[4],
+  const double y[4],
+  bool &is_concave)
+{
+  const double o012 = orientation(x[0], y[0], x[1], y[1], x[2], y[2]);
+  const double o023 = orientation(x[0], y[0], x[2], y[2], x[3], y[3]);
+  const double o013 = orientation(x[0], y[0], x[1], y[1], x[3], y[3]);
+  const double o123 = orientation(x[1], y[1], x[2], y[2], x[3], y[3]);
+
+  // The turns at the corners 1, 3, 0 and 2 have the orientations o012, o023,
+  // o013 and o123, respectively.
+  const bool has_left_turn = (o012 > 0) | (o023 > 0) | (o013 > 0) | (o123 > 0);
+  const bool has_right_turn =
+    (o012 < 0) | (o023 < 0) | (o013 < 0) | (o123 < 0);
+  is_concave = has_left_turn & has_right_turn;
+  const bool diag_0_inside =
+    ((o012 > 0) & (o023 > 0)) | ((o012 < 0) & (o023 < 0));
+  const bool diag_1_inside =
+    ((o013 > 0) & (o123 > 0)) | ((o013 < 0) & (o123 < 0));
+  return diag_0_inside ? 0 : (diag_1_inside ? 1 : -1);
+}
+
 // TODO: chosen_diag() seems to be more naturally thought of as a boolean
 //       than an integer.
 
@@ -179,29 +274,19 @@ int InsetState::chosen_diag(
     tv[i] = projected_point(v[i], project_original);
   }
 
-  // Get the two possible midpoints
-  const Point midpoint_diag_0(
-    (tv[0].x() + tv[2].x()) / 2,
-    (tv[0].y() + tv[2].y()) / 2);
-  const Point midpoint_diag_1(
-    (tv[1].x() + tv[3].x()) / 2,
-    (tv[1].y() + tv[3].y()) / 2);
-
-  // Get the transformed graticule cell as a polygon
-  Polygon trans_graticule;
-  for (auto &i : tv) {
-    trans_graticule.push_back(i);
+  double x[4];
+  double y[4];
+  for (unsigned int i = 0; i < 4; ++i) {
+    x[i] = tv[i].x();
+    y[i] = tv[i].y();
   }
-
-  // Check if graticule cell is concave
-  if (!trans_graticule.is_convex()) {
+  bool is_concave;
+  const int diag = diag_inside_quadrilateral(x, y, is_concave);
+  if (is_concave) {
     num_concave += 1;
   }
-  if (trans_graticule.bounded_side(midpoint_diag_0) == CGAL::ON_BOUNDED_SIDE) {
-    return 0;
-  }
-  if (trans_graticule.bounded_side(midpoint_diag_1) == CGAL::ON_BOUNDED_SIDE) {
-    return 1;
+  if (diag >= 0) {
+    return diag;
   }
   std::cerr << "Invalid graticule cell! At\n";
   std::cerr << "(" << tv[0].x() << ", " << tv[0].y() << ")\n";
@@ -222,24 +307,105 @@ void InsetState::fill_graticule_diagonals(const bool project_original)
 {
   // Initialize array if running for the first time
   if (
-    graticule_diagonals_.shape()[0] != lx_ ||
-    graticule_diagonals_.shape()[1] != ly_) {
+    graticule_diagonals_.shape()[0] != lx_ - 1 ||
+    graticule_diagonals_.shape()[1] != ly_ - 1) {
     graticule_diagonals_.resize(boost::extents[lx_ - 1][ly_ - 1]);
   }
   unsigned int n_concave = 0;  // Count concave graticule cells
-
-#pragma omp parallel for default(none) shared(n_concave, project_original)
+  unsigned int n_invalid = 0;  // Count cells without a diagonal inside
+
+  // The corners of the cell (i, j) are the projected grid points (i, j),
+  // (i + 1, j), (i + 1, j + 1) and (i, j + 1). None of them is on the edge of
+  // the grid, so that they can be read directly from the projection. The
+  // inner loop runs along rows of the projection, which are contiguous in
+  // memory.
+  const auto &proj = project_original ? cum_proj_ : proj_;
+#pragma omp parallel for default(none) shared(proj) \
+  reduction(+ : n_concave, n_invalid)
   for (unsigned int i = 0; i < lx_ - 1; ++i) {
+    const XYPoint *row = &proj[i][0];
+    const XYPoint *next_row = &proj[i + 1][0];
+    int *diags = &graticule_diagonals_[i][0];
+#pragma omp simd reduction(+ : n_concave, n_invalid)
     for (unsigned int j = 0; j < ly_ - 1; ++j) {
-      Point v[4];
-      v[0] = Point(double(i) + 0.5, double(j) + 0.5);
-      v[1] = Point(double(i) + 1.5, double(j) + 0.5);
-      v[2] = Point(double(i) + 1.5, double(j) + 1.5);
-      v[3] = Point(double(i) + 0.5, double(j) + 1.5);
-      graticule_diagonals_[i][j] = chosen_diag(v, n_concave, project_original);
+      const double x[4] =
+        {row[j].x, next_row[j].x, next_row[j + 1].x, row[j + 1].x};
+      const double y[4] =
+        {row[j].y, next_row[j].y, next_row[j + 1].y, row[j + 1].y};
+      bool is_concave;
+      diags[j] = diag_inside_quadrilateral(x, y, is_concave);
+      n_concave += is_concave;
+      n_invalid += (diags[j] < 0);
     }
   }
   std::cerr << "Number of concave graticule cells: " << n_concave << std::endl;
+
+  // If the topology of a cell is invalid, let chosen_diag() report the first
+  // such cell and exit
+  if (n_invalid > 0) {
+    for (unsigned int i = 0; i < lx_ - 1; ++i) {
+      for (unsigned int j = 0; j < ly_ - 1; ++j) {
+        if (graticule_diagonals_[i][j] < 0) {
+          Point v[4];
+          v[0] = Point(double(i) + 0.5, double(j) + 0.5);
+          v[1] = Point(double(i) + 1.5, double(j) + 0.5);
+          v[2] = Point(double(i) + 1.5, double(j) + 1.5);
+          v[3] = Point(double(i) + 0.5, double(j) + 1.5);
+          unsigned int n_concave_in_cell = 0;
+          chosen_diag(v, n_concave_in_cell, project_original);
+        }
+      }
+    }
+  }
+
+  // Compute the affine maps of the two triangles in each cell, so that
+  // projected_point_with_triangulation() only needs to choose a triangle and
+  // apply its map. The maps are computed as in affine_trans(). The cells at
+  // the edge of the grid are marked with diag = -1. Their diagonals are not
+  // in graticule_diagonals_, and projected_point_with_triangulation() only
+  // chooses them if a point lies in such a cell.
+  triangulated_cells_.resize(static_cast<std::size_t>(lx_ + 1) * (ly_ + 1));
+  triangulated_cells_are_original_ = project_original;
+#pragma omp parallel for default(none) shared(project_original)
+  for (unsigned int a = 0; a <= lx_; ++a) {
+    for (unsigned int b = 0; b <= ly_; ++b) {
+      triangulated_cell &cell =
+        triangulated_cells_[static_cast<std::size_t>(a) * (ly_ + 1) + b];
+      if (a == 0 || b == 0 || a == lx_ || b == ly_) {
+        cell.diag = -1;
+        continue;
+      }
+      cell.diag = graticule_diagonals_[a - 1][b - 1];
+      Point v[4];
+      v[0] = Point(a - 0.5, b - 0.5);
+      v[1] = Point(a + 0.5, b - 0.5);
+      v[2] = Point(a + 0.5, b + 0.5);
+      v[3] = Point(a - 0.5, b + 0.5);
+      Point tv[4];
+      for (unsigned int i = 0; i < 4; ++i) {
+        tv[i] = projected_point(v[i], project_original);
+      }
+
+      // Corners of the two triangles, in the same order as in
+      // untransformed_triangle()
+      const unsigned int corners[2][2][3] = {
+        {{0, 1, 2}, {0, 2, 3}},
+        {{0, 1, 3}, {1, 2, 3}}};
+      for (unsigned int k = 0; k < 2; ++k) {
+        const unsigned int *c = corners[cell.diag][k];
+        const Matrix abc_mA(v[c[0]], v[c[1]], v[c[2]]);
+        const Matrix pqr_mP(tv[c[0]], tv[c[1]], tv[c[2]]);
+        const auto mT = pqr_mP.multiplied_with(abc_mA.inverse());
+        double *map = cell.maps[k];
+        map[0] = mT.p11;
+        map[1] = mT.p12;
+        map[2] = mT.p13;
+        map[3] = mT.p21;
+        map[4] = mT.p22;
+        map[5] = mT.p23;
+      }
+    }
+  }
 }
 
 std::array<Point, 3> InsetState::transformed_triangle(
@@ -423,7 +589,50 @@ Point InsetState::projected_point_with_triangulation(
   const Point pt,
   const bool project_original) const
 {
-  // Get the untransformed triangle the point pt is in
+  // Cell around the nearest grid point. Points outside the grid are
+  // reported by untransformed_triangle() below.
+  const double a = floor(pt.x() + 0.5);
+  const double b = floor(pt.y() + 0.5);
+  const bool has_triangulated_cell =
+    triangulated_cells_.size() ==
+      static_cast<std::size_t>(lx_ + 1) * (ly_ + 1) &&
+    triangulated_cells_are_original_ == project_original && a >= 1.0 &&
+    b >= 1.0 && a < lx_ && b < ly_;
+  if (
+    has_triangulated_cell &&
+    triangulated_cells_[static_cast<std::size_t>(a) * (ly_ + 1) +
+                        static_cast<std::size_t>(b)]
+        .diag >= 0) {
+    const triangulated_cell &cell = triangulated_cells_
+      [static_cast<std::size_t>(a) * (ly_ + 1) + static_cast<std::size_t>(b)];
+    const double x0 = a - 0.5;
+    const double x1 = a + 0.5;
+    const double y0 = b - 0.5;
+    const double y1 = b + 0.5;
+
+    // The sign of the cross product tells on which side of the diagonal pt
+    // lies. Triangle 0 contains the lower right corner (x1, y0) if diag is
+    // 0 and the lower left corner (x0, y0) if diag is 1. Points on the
+    // diagonal belong to triangle 0, as in untransformed_triangle().
+    unsigned int k;
+    if (cell.diag == 0) {
+      const double cross =
+        (x1 - x0) * (pt.y() - y0) - (y1 - y0) * (pt.x() - x0);
+      k = (cross <= 0.0) ? 0 : 1;
+    } else {
+      const double cross =
+        (x0 - x1) * (pt.y() - y0) - (y1 - y0) * (pt.x() - x1);
+      k = (cross >= 0.0) ? 0 : 1;
+    }
+    const double *map = cell.maps[k];
+    const Point transformed_pt(
+      map[0] * pt.x() + map[1] * pt.y() + map[2],
+      map[3] * pt.x() + map[4] * pt.y() + map[5]);
+    return rounded_point(transformed_pt, lx_, ly_);
+  }
+
+  // In cells at the edge of the grid, or if the cells have not been
+  // computed, get the untransformed triangle the point pt is in
   const auto old_triangle = untransformed_triangle(pt, project_original);
 
   // Get the coordinates of the transformed triangle
@@ -441,7 +650,7 @@ void InsetState::project_with_triangulation()
   // projected_point_with_triangulation
   // https://www.nextptr.com/tutorial/ta1430524603/
   // capture-this-in-lambda-expression-timeline-of-change
-  std::function<Point(Point)> lambda = [&](Point p1) {
+  const auto lambda = [&](Point p1) {
     return projected_point_with_triangulation(p1);
   };
 
@@ -463,32 +672,10 @@ void InsetState::project_with_triangulation()
 
 void InsetState::project_with_cum_proj()
 {
-  std::function<Point(Point)> lambda = [&](Point p1) {
+  const auto lambda = [&](Point p1) {
     return projected_point_with_triangulation(p1, true);
   };
 
   // Transforming all points based on triangulation
   transform_points(lambda, true);
 }
-
-Point interpolate_point_with_proj_sequence(
-  Point p,
-  const std::vector<proj_qd> &proj_sequence_)
-{
-  for (const auto &prj_qd : proj_sequence_) {
-    auto &dt = prj_qd.dt;
-    auto &proj_map = prj_qd.triangle_transformation;
-    p = interpolate_point_with_barycentric_coordinates(p, dt, proj_map);
-  }
-  return p;
-}
-
-void InsetState::project_with_proj_sequence()
-{
-  std::function<Point(Point)> lambda = [&](Point p1) {
-    return interpolate_point_with_proj_sequence(p1, proj_sequence_);
-  };
-
-  // Apply the function on the original points
-  transform_points(lambda, true);
-}
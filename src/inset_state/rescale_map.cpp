@@ -29,28 +29,34 @@ void InsetState::rescale_map(
   double new_ymax =
     0.5 * ((1.0 + padding) * bb.ymax() + (1.0 - padding) * bb.ymin());
 
-  // Ensure that the grid dimensions lx and ly are integer powers of 2
+  // Ensure that the grid dimensions lx and ly are FFT-friendly, that is, of
+  // the form 2^a * 3^b * 5^c * 7^d. The shorter side is the smallest such
+  // number that covers the padded bounding box. World maps must fill the
+  // grid exactly because the inverse Smyth-Craster projection assumes that
+  // lx = 2 * ly. Hence, max_n_grid_rows_or_cols must then be even.
   unsigned int lx, ly;
   if (
-    (max_n_grid_rows_or_cols <= 0) ||
-    ((max_n_grid_rows_or_cols & (~max_n_grid_rows_or_cols + 1)) !=
-     max_n_grid_rows_or_cols)) {
-    std::cerr
-      << "ERROR: max_n_grid_rows_or_cols must be an integer power of 2."
-      << std::endl;
+    !is_fft_friendly(max_n_grid_rows_or_cols) ||
+    (is_world_map && max_n_grid_rows_or_cols % 2 != 0)) {
+    std::cerr << "ERROR: max_n_grid_rows_or_cols must be of the form "
+              << "2^a * 3^b * 5^c * 7^d"
+              << (is_world_map ? " and even for world maps." : ".")
+              << std::endl;
     _Exit(15);
   }
   double latt_const;
   if (bb.xmax() - bb.xmin() > bb.ymax() - bb.ymin()) {
     lx = max_n_grid_rows_or_cols;
     latt_const = (new_xmax - new_xmin) / lx;
-    ly = 1 << static_cast<int>(ceil(log2((new_ymax - new_ymin) / latt_const)));
+    ly = fft_friendly_size(
+      static_cast<unsigned int>(ceil((new_ymax - new_ymin) / latt_const)));
     new_ymax = 0.5 * (bb.ymax() + bb.ymin()) + 0.5 * ly * latt_const;
     new_ymin = 0.5 * (bb.ymax() + bb.ymin()) - 0.5 * ly * latt_const;
   } else {
     ly = max_n_grid_rows_or_cols;
     latt_const = (new_ymax - new_ymin) / ly;
-    lx = 1 << static_cast<int>(ceil(log2((new_xmax - new_xmin) / latt_const)));
+    lx = fft_friendly_size(
+      static_cast<unsigned int>(ceil((new_xmax - new_xmin) / latt_const)));
     new_xmax = 0.5 * (bb.xmax() + bb.xmin()) + 0.5 * lx * latt_const;
     new_xmin = 0.5 * (bb.xmax() + bb.xmin()) - 0.5 * lx * latt_const;
   }
@@ -60,21 +66,10 @@ void InsetState::rescale_map(
   set_grid_dimensions(lx, ly);
 
   // Rescale and translate all GeoDiv coordinates
-  const Transformation translate(
-    CGAL::TRANSLATION,
-    CGAL::Vector_2<Scd>(-new_xmin, -new_ymin));
-  const Transformation scale(CGAL::SCALING, (1.0 / latt_const));
-  for (auto &gd : geo_divs_) {
-    for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
-      auto *ext_ring = &pwh.outer_boundary();
-      *ext_ring = transform(translate, *ext_ring);
-      *ext_ring = transform(scale, *ext_ring);
-      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
-        *h = transform(translate, *h);
-        *h = transform(scale, *h);
-      }
-    }
-  }
+  const double scale = 1.0 / latt_const;
+  transform_points([new_xmin, new_ymin, scale](const Point p) {
+    return Point((p.x() - new_xmin) * scale, (p.y() - new_ymin) * scale);
+  });
 }
 
 void InsetState::normalize_inset_area(
@@ -90,21 +85,11 @@ void InsetState::normalize_inset_area(
     equal_area ? 1.0 : sqrt(inset_area_prop / total_inset_area());
 
   // Rescale and translate all GeoDiv coordinates
-  const Transformation translate(
-    CGAL::TRANSLATION,
-    CGAL::Vector_2<Scd>(
-      -(bb.xmin() + bb.xmax()) / 2,
-      -(bb.ymin() + bb.ymax()) / 2));
-  const Transformation scale(CGAL::SCALING, scale_factor);
-  for (auto &gd : geo_divs_) {
-    for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
-      auto *ext_ring = &pwh.outer_boundary();
-      *ext_ring = transform(translate, *ext_ring);
-      *ext_ring = transform(scale, *ext_ring);
-      for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
-        *h = transform(translate, *h);
-        *h = transform(scale, *h);
-      }
-    }
-  }
+  const double x_center = (bb.xmin() + bb.xmax()) / 2;
+  const double y_center = (bb.ymin() + bb.ymax()) / 2;
+  transform_points([x_center, y_center, scale_factor](const Point p) {
+    return Point(
+      (p.x() - x_center) * scale_factor,
+      (p.y() - y_center) * scale_factor);
+  });
 }
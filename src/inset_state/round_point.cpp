@@ -37,6 +37,10 @@ double rounded_to_bicimal(
 {
   double whole;
   const double fractional = std::modf(d, &whole);
+
+  // Keep 36 significant bits. The integer part of any coordinate in
+  // [0, max(lx, ly)] needs at most bit_width(max(lx, ly)) of them, whether
+  // or not lx and ly are powers of 2.
   const unsigned int n_bicimals = 36 - std::bit_width(std::max(lx, ly));
   const unsigned long int power_of_2 =
     (static_cast<unsigned long int>(1) << n_bicimals);
@@ -1,12 +1,199 @@
 #include "inset_state.h"
+#include <numeric>
+#include <omp.h>
 
-// TODO: THE OUTPUT FROM intersec_with_parallel_to() ALWAYS
-// SEEM TO COME WITH A NEED TO SORT AFTERWARDS. SHOULD SORTING BECOME PART of
-// intersec_with_parallel_to() TO SAVE TYPING ELSEWHERE?
+// Function to add the edges of the ring of n points to the edge table. Edges
+// that are parallel to the rays are skipped because ray_intersects() ignores
+// them.
+static void add_edges_to_edge_table(
+  std::vector<scanline_edge> &edge_table,
+  const XYPoint *ring,
+  const std::size_t n,
+  const char axis,
+  const unsigned int resolution,
+  const unsigned int n_rays)
+{
+  XYPoint prev_point = ring[n - 1];
+  for (std::size_t i = 0; i < n; ++i) {
+    const XYPoint curr_point = ring[i];
+    const double curr = (axis == 'x' ? curr_point.y : curr_point.x);
+    const double prev = (axis == 'x' ? prev_point.y : prev_point.x);
+    if (curr != prev) {
+
+      // The ray with index i has the coordinate (i + 0.5) / resolution. We
+      // widen the range of indices by one on each side so that rounding
+      // errors cannot drop a ray. ray_intersects() performs the exact test.
+      const double first_ray = std::max(
+        0.0,
+        std::ceil(std::min(curr, prev) * resolution - 0.5) - 1);
+      const double last_ray = std::min(
+        n_rays - 1.0,
+        std::floor(std::max(curr, prev) * resolution - 0.5) + 1);
+      if (first_ray <= last_ray) {
+        edge_table.push_back(
+          {curr_point,
+           prev_point,
+           static_cast<unsigned int>(first_ray),
+           static_cast<unsigned int>(last_ray)});
+      }
+    }
+    prev_point = curr_point;
+  }
+}
+
+// Function to intersect the "polygon with holes" with index pwh_index in
+// flat_geo_divs with all rays that it spans, using an active edge table. The
+// edges are sorted by the first ray that they can intersect, and the rays
+// are swept in ascending order while keeping track of the edges that span
+// the current ray. Thus, each edge is only tested against the rays that it
+// spans, instead of every ray in the bounding box of the polygon. The
+// previous contents of result are replaced.
+static void intersect_pwh_with_rays(
+  const FlatGeometry &flat_geo_divs,
+  const std::size_t pwh_index,
+  const unsigned int geo_div_index,
+  const char axis,
+  const unsigned int resolution,
+  const unsigned int n_rays,
+  scanline_thread_buffers &buffers,
+  pwh_intersections &result)
+{
+  // We add a small value `epsilon` to the ray coordinate so that we assign
+  // correct densities if the ray with equation y = ray_y or x = ray_x goes
+  // exactly through a vertex. The addition ensures that, if there is any
+  // intersection, it is only counted once. This method also correctly
+  // detects whether the ray touches the point without entering or exiting
+  // the polygon.
+  const double epsilon = 1e-6 / resolution;
+  result.clear();
+  std::vector<scanline_edge> &edge_table = buffers.edge_table;
+  edge_table.clear();
+  const auto &ring_offsets = flat_geo_divs.ring_offsets();
+  const auto &pwh_offsets = flat_geo_divs.pwh_offsets();
+  for (std::size_t ring_index = pwh_offsets[pwh_index];
+       ring_index < pwh_offsets[pwh_index + 1];
+       ++ring_index) {
+    add_edges_to_edge_table(
+      edge_table,
+      flat_geo_divs.points().data() + ring_offsets[ring_index],
+      ring_offsets[ring_index + 1] - ring_offsets[ring_index],
+      axis,
+      resolution,
+      n_rays);
+  }
+  if (edge_table.empty()) {
+    return;
+  }
+
+  // Sort the edges by the first ray that they can intersect. Edges with the
+  // same first ray keep their order, as with std::stable_sort(), but the
+  // counting sort does not allocate a temporary array.
+  unsigned int min_first_ray = edge_table.front().first_ray;
+  unsigned int max_first_ray = min_first_ray;
+  for (const auto &edge : edge_table) {
+    min_first_ray = std::min(min_first_ray, edge.first_ray);
+    max_first_ray = std::max(max_first_ray, edge.first_ray);
+  }
+  std::vector<std::size_t> &ray_offsets = buffers.ray_offsets;
+  ray_offsets.assign(max_first_ray - min_first_ray + 2, 0);
+  for (const auto &edge : edge_table) {
+    ++ray_offsets[edge.first_ray - min_first_ray + 1];
+  }
+  std::partial_sum(ray_offsets.begin(), ray_offsets.end(), ray_offsets.begin());
+  buffers.sorted_edge_table.resize(edge_table.size());
+  for (const auto &edge : edge_table) {
+    buffers.sorted_edge_table[ray_offsets[edge.first_ray - min_first_ray]++] =
+      edge;
+  }
+  edge_table.swap(buffers.sorted_edge_table);
+
+  // Sweep over the rays
+  std::vector<scanline_edge> &active_edges = buffers.active_edges;
+  active_edges.clear();
+  std::size_t next_edge = 0;
+  unsigned int ray_index = edge_table.front().first_ray;
+  while (next_edge < edge_table.size() || !active_edges.empty()) {
+
+    // If no edge is active, jump to the next ray that an edge spans
+    if (active_edges.empty()) {
+      ray_index = edge_table[next_edge].first_ray;
+    }
+    while (next_edge < edge_table.size() &&
+           edge_table[next_edge].first_ray == ray_index) {
+      active_edges.push_back(edge_table[next_edge]);
+      ++next_edge;
+    }
+
+    // Intersect the active edges with the ray
+    const double ray = (ray_index + 0.5) / resolution;
+    const std::size_t first = result.size();
+    for (const auto &edge : active_edges) {
+      intersection temp;
+      if (temp.ray_intersects(
+            edge.curr_point,
+            edge.prev_point,
+            ray,
+            epsilon,
+            axis == 'x')) {
+        temp.geo_div_index = geo_div_index;
+        result.emplace_back(ray_index, temp);
+      }
+    }
+
+    // Check whether the number of intersections is odd
+    if ((result.size() - first) % 2 != 0) {
+      std::cerr << "Incorrect Topology.\n"
+                << "Number of intersections: " << result.size() - first
+                << "\n"
+                << axis << "-coordinate: " << ray << "\n"
+                << "Intersection points: " << std::endl;
+
+      for (std::size_t l = first; l < result.size(); ++l) {
+        std::cerr << (axis == 'x' ? result[l].second.x()
+                                  : result[l].second.y())
+                  << std::endl;
+      }
+      std::cerr << std::endl << std::endl;
+      _Exit(932875);
+    }
+
+    // Sort the intersections with this ray and assign directions
+    std::sort(
+      result.begin() + static_cast<std::ptrdiff_t>(first),
+      result.end(),
+      [](const auto &i1, const auto &i2) { return i1.second < i2.second; });
+    for (std::size_t l = first; l < result.size(); ++l) {
+      result[l].second.ray_enters = ((l - first) % 2 == 0);
+    }
+
+    // Remove the edges that do not span the next ray
+    ++ray_index;
+    std::erase_if(active_edges, [ray_index](const scanline_edge &edge) {
+      return edge.last_ray < ray_index;
+    });
+  }
+}
 
 std::vector<std::vector<intersection> > InsetState::intersec_with_parallel_to(
   char axis,
   unsigned int resolution) const
+{
+  std::vector<std::vector<intersection> > scanlines;
+  intersec_with_parallel_to(axis, resolution, scanlines);
+  return scanlines;
+}
+
+// Function to find the intersections of all GeoDivs with rays parallel to
+// the given axis. The "polygons with holes" are intersected with the rays in
+// parallel, each thread writing into separate per-polygon buffers. The
+// buffers are then merged in the order of geo_divs_ so that the result does
+// not depend on the number of threads. The intersections of each ray are
+// sorted in ascending order. All arrays are kept in rasterizer_buffers_ and
+// scanlines between calls.
+void InsetState::intersec_with_parallel_to(
+  char axis,
+  unsigned int resolution,
+  std::vector<std::vector<intersection> > &scanlines) const
 {
   if (axis != 'x' && axis != 'y') {
     std::cerr << "Invalid axis in " << __func__ << "()" << std::endl;
@@ -14,103 +201,96 @@ std::vector<std::vector<intersection> > InsetState::intersec_with_parallel_to(
   }
   const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
   const unsigned int n_rays = grid_length * resolution;
-  std::vector<std::vector<intersection> > scanlines(n_rays);
-
-  // Iterate over GeoDivs in inset_state
-  for (const auto &gd : geo_divs_) {
-
-    // Find target density
-    const double target_density = target_areas_.at(gd.id()) / gd.area();
-
-    // Iterate over "polygons with holes" in inset_state
-    for (const auto &pwh : gd.polygons_with_holes()) {
-      const Bbox bb = pwh.bbox();
-      double min_lim, max_lim;
-      if (axis == 'x') {
-        min_lim = bb.ymin();
-        max_lim = bb.ymax();
-      } else {
-        min_lim = bb.xmin();
-        max_lim = bb.xmax();
-      }
+  RasterizerBuffers &buffers = rasterizer_buffers_;
 
-      // Iterate over coordinates in bounding box of pwh
-      for (unsigned int k = static_cast<unsigned int>(floor(min_lim)) - 1;
-           k <= ceil(max_lim) + 1;
-           ++k) {
-
-        // If the rays are in x-direction, iterate over each ray between the
-        // graticule lines y = k and y = k+1. Otherwise, iterate over each
-        // ray between x = k and x = k+1.
-        for (double ray = k + 0.5 / resolution; ray < k + 1;
-             ray += (1.0 / resolution)) {
-
-          // Temporary vector of intersections for this particular ray
-          std::vector<intersection> intersections;
-
-          // The following algorithm works by iterating over "resolution" rays
-          // in each cell. // For each ray, we iterate over each edge in a
-          // polygon and store all intersections. Afterward, we add the
-          // appropriate densities. We add a small value `epsilon` to the ray
-          // coordinate so that we assign correct densities if the ray with
-          // equation y = ray_y or x = ray_x goes exactly through curr_point.
-          // The addition ensures that, if there is any intersection, it is
-          // only counted once. This method also correctly detects whether the
-          // ray touches the point without entering or exiting the polygon.
-          const double epsilon = 1e-6 / resolution;
-
-          // Run algorithm on exterior ring
-          add_intersections(
-            intersections,
-            pwh.outer_boundary(),
-            ray,
-            target_density,
-            epsilon,
-            gd.id(),
-            axis);
-
-          // Run algorithm on each hole
-          for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
-            add_intersections(
-              intersections,
-              *h,
-              ray,
-              target_density,
-              epsilon,
-              gd.id(),
-              axis);
-          }
+  // Index of the GeoDiv to which each "polygon with holes" belongs, and the
+  // largest number of points in a "polygon with holes", which bounds the
+  // size of the edge tables
+  const FlatGeometry &flat_geo_divs = this->flat_geo_divs();
+  const auto &geo_div_offsets = flat_geo_divs.geo_div_offsets();
+  const auto &pwh_offsets = flat_geo_divs.pwh_offsets();
+  const auto &ring_offsets = flat_geo_divs.ring_offsets();
+  const std::size_t n_pwhs = geo_div_offsets.back();
+  std::vector<unsigned int> &pwh_geo_divs = buffers.pwh_geo_divs;
+  pwh_geo_divs.resize(n_pwhs);
+  for (unsigned int gd_index = 0; gd_index < flat_geo_divs.n_geo_divs();
+       ++gd_index) {
+    std::fill(
+      pwh_geo_divs.begin() +
+        static_cast<std::ptrdiff_t>(geo_div_offsets[gd_index]),
+      pwh_geo_divs.begin() +
+        static_cast<std::ptrdiff_t>(geo_div_offsets[gd_index + 1]),
+      gd_index);
+  }
+  std::size_t max_pwh_points = 0;
+  for (std::size_t k = 0; k < n_pwhs; ++k) {
+    max_pwh_points = std::max(
+      max_pwh_points,
+      ring_offsets[pwh_offsets[k + 1]] - ring_offsets[pwh_offsets[k]]);
+  }
 
-          // Check whether the number of intersections is odd
-          if (intersections.size() % 2 != 0) {
-            std::cerr << "Incorrect Topology.\n"
-                      << "Number of intersections: " << intersections.size()
-                      << "\n"
-                      << axis << "-coordinate: " << ray << "\n"
-                      << "Intersection points: " << std::endl;
-
-            for (auto &intersection : intersections) {
-              std::cerr << (axis == 'x' ? intersection.x() : intersection.y())
-                        << std::endl;
-            }
-            std::cerr << std::endl << std::endl;
-            _Exit(932875);
-          }
-          std::sort(intersections.begin(), intersections.end());
-
-          // Assign directions to intersections and add sorted vector of
-          // intersections to vector `scanlines`
-          const auto index = static_cast<unsigned int>(
-            round((ray - 0.5 / resolution) * resolution));
-          for (unsigned int l = 0; l < intersections.size(); ++l) {
-            intersections[l].ray_enters = (l % 2 == 0);
-            scanlines[index].push_back(intersections[l]);
-          }
-        }
-      }
+  // Intersect each "polygon with holes" with the rays. Polygons differ
+  // widely in their number of vertices. Hence, the schedule is dynamic.
+  std::vector<pwh_intersections> &intersections = buffers.intersections;
+  intersections.resize(n_pwhs);
+  buffers.scanline_threads.resize(omp_get_max_threads());
+#pragma omp parallel default(none) shared( \
+  buffers,                                 \
+  flat_geo_divs,                           \
+  pwh_geo_divs,                            \
+  intersections,                           \
+  axis,                                    \
+  max_pwh_points,                          \
+  resolution,                              \
+  n_pwhs,                                  \
+  n_rays)
+  {
+    scanline_thread_buffers &thread_buffers =
+      buffers.scanline_threads[omp_get_thread_num()];
+    thread_buffers.edge_table.reserve(max_pwh_points);
+    thread_buffers.sorted_edge_table.reserve(max_pwh_points);
+    thread_buffers.active_edges.reserve(max_pwh_points);
+    thread_buffers.ray_offsets.reserve(n_rays + 1);
+#pragma omp for schedule(dynamic)
+    for (std::size_t k = 0; k < n_pwhs; ++k) {
+      intersect_pwh_with_rays(
+        flat_geo_divs,
+        k,
+        pwh_geo_divs[k],
+        axis,
+        resolution,
+        n_rays,
+        thread_buffers,
+        intersections[k]);
     }
   }
-  return scanlines;
+
+  // Count the intersections of each ray so that every scanline grows at
+  // most once. Then copy the intersections into the scanlines in the order
+  // of the "polygons with holes".
+  std::vector<std::size_t> &n_intersections = buffers.n_intersections;
+  n_intersections.assign(n_rays, 0);
+  for (const auto &pwh_ints : intersections) {
+    for (const auto &[ray_index, intersec] : pwh_ints) {
+      ++n_intersections[ray_index];
+    }
+  }
+  scanlines.resize(n_rays);
+  for (unsigned int ray_index = 0; ray_index < n_rays; ++ray_index) {
+    scanlines[ray_index].clear();
+    scanlines[ray_index].reserve(n_intersections[ray_index]);
+  }
+  for (const auto &pwh_ints : intersections) {
+    for (const auto &[ray_index, intersec] : pwh_ints) {
+      scanlines[ray_index].push_back(intersec);
+    }
+  }
+
+  // Sort the intersections of different "polygons with holes" along each ray
+#pragma omp parallel for default(none) shared(scanlines, n_rays)
+  for (unsigned int ray_index = 0; ray_index < n_rays; ++ray_index) {
+    std::sort(scanlines[ray_index].begin(), scanlines[ray_index].end());
+  }
 }
 
 // Creates continuity/adjacency graph using horizontal and vertical scans
@@ -120,41 +300,23 @@ void InsetState::create_contiguity_graph(unsigned int resolution)
   for (char axis : {'x', 'y'}) {
     const std::vector<std::vector<intersection> > scanlines =
       intersec_with_parallel_to(axis, resolution);
-    const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
-
-    // Iterate over rows (if axis is 'x') or columns
-    for (unsigned int k = 0; k < grid_length; ++k) {
-
-      // Iterate over rays in this row or column
-      for (double ray = k + 0.5 / resolution; ray < k + 1;
-           ray += (1.0 / resolution)) {
-
-        // Intersections for one ray
-        std::vector<intersection> intersections =
-          scanlines[static_cast<unsigned int>(
-            round((ray - (0.5 / resolution) * resolution)))];
-
-        // Sort intersections in ascending order
-        sort(intersections.begin(), intersections.end());
-        const int size = static_cast<int>(intersections.size()) - 1;
-
-        // Find adjacent GeoDivs by iterating over intersections
-        for (int l = 1; l < size; l += 2) {
-          const double coord_1 = intersections[l].x();
-          const double coord_2 = intersections[l + 1].x();
-          const std::string gd_1 = intersections[l].geo_div_id;
-          const std::string gd_2 = intersections[l + 1].geo_div_id;
-
-          // Update adjacency
-          if (gd_1 != gd_2 && coord_1 == coord_2) {
-            for (auto &gd : geo_divs_) {
-              if (gd.id() == gd_1) {
-                gd.adjacent_to(gd_2);
-              } else if (gd.id() == gd_2) {
-                gd.adjacent_to(gd_1);
-              }
-            }
-          }
+
+    // Iterate over rays. The intersections of each ray are already sorted in
+    // ascending order.
+    for (const auto &intersections : scanlines) {
+      const int size = static_cast<int>(intersections.size()) - 1;
+
+      // Find adjacent GeoDivs by iterating over intersections
+      for (int l = 1; l < size; l += 2) {
+        const double coord_1 = intersections[l].x();
+        const double coord_2 = intersections[l + 1].x();
+        const unsigned int gd_1 = intersections[l].geo_div_index;
+        const unsigned int gd_2 = intersections[l + 1].geo_div_index;
+
+        // Update adjacency
+        if (gd_1 != gd_2 && coord_1 == coord_2) {
+          geo_divs_[gd_1].adjacent_to(geo_divs_[gd_2].id());
+          geo_divs_[gd_2].adjacent_to(geo_divs_[gd_1].id());
         }
       }
     }
@@ -169,40 +331,30 @@ std::vector<Segment> InsetState::intersecting_segments(
   for (char axis : {'x', 'y'}) {
     const std::vector<std::vector<intersection> > scanlines =
       intersec_with_parallel_to(axis, resolution);
-    const unsigned int grid_length = (axis == 'x' ? ly_ : lx_);
-
-    // Iterate over rows (if axis is 'x') or columns
-    for (unsigned int k = 0; k < grid_length; ++k) {
-
-      // Iterate over rays in this row or column
-      for (double ray = k + 0.5 / resolution; ray < k + 1;
-           ray += (1.0 / resolution)) {
-
-        // Intersections for one ray
-        std::vector<intersection> intersec =
-          scanlines[static_cast<unsigned int>(
-            round((ray - (0.5 / resolution) * resolution)))];
-
-        // Sort intersections in ascending order
-        std::sort(intersec.begin(), intersec.end());
-
-        // Check whether intersection enters twice or exits twice
-        for (size_t l = 0; l + 1 < intersec.size(); ++l) {
-          if (
-            intersec[l].ray_enters == intersec[l + 1].ray_enters &&
-            intersec[l].ray_enters && l + 2 <= intersec.size()) {
-            Segment temp;
-            if (axis == 'x' && intersec[l + 1].x() != intersec[l + 2].x()) {
-              temp = Segment(
-                Point(intersec[l + 1].x(), ray),
-                Point(intersec[l + 2].x(), ray));
-              int_segments.push_back(temp);
-            } else if (intersec[l + 1].y() != intersec[l + 2].y()) {
-              temp = Segment(
-                Point(ray, intersec[l + 1].y()),
-                Point(ray, intersec[l + 2].y()));
-              int_segments.push_back(temp);
-            }
+
+    // Iterate over rays. The intersections of each ray are already sorted in
+    // ascending order.
+    for (unsigned int ray_index = 0; ray_index < scanlines.size();
+         ++ray_index) {
+      const double ray = (ray_index + 0.5) / resolution;
+      const std::vector<intersection> &intersec = scanlines[ray_index];
+
+      // Check whether intersection enters twice or exits twice
+      for (size_t l = 0; l + 1 < intersec.size(); ++l) {
+        if (
+          intersec[l].ray_enters == intersec[l + 1].ray_enters &&
+          intersec[l].ray_enters && l + 2 < intersec.size()) {
+          Segment temp;
+          if (axis == 'x' && intersec[l + 1].x() != intersec[l + 2].x()) {
+            temp = Segment(
+              Point(intersec[l + 1].x(), ray),
+              Point(intersec[l + 2].x(), ray));
+            int_segments.push_back(temp);
+          } else if (intersec[l + 1].y() != intersec[l + 2].y()) {
+            temp = Segment(
+              Point(ray, intersec[l + 1].y()),
+              Point(ray, intersec[l + 2].y()));
+            int_segments.push_back(temp);
           }
         }
       }
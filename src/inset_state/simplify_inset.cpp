@@ -95,8 +95,9 @@ void InsetState::simplify(const unsigned int target_points_per_inset)
 
   // Store Polygons as a CT (Constrained Triangulation) object. Code inspired
   // by https://doc.cgal.org/latest/Polyline_simplification_2/index.html
+  std::vector<GeoDiv> &geo_divs = *ref_to_geo_divs();
   CT ct;
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       ct.insert_constraint(pwh.outer_boundary());
       for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
@@ -131,7 +132,7 @@ void InsetState::simplify(const unsigned int target_points_per_inset)
     boost::counting_iterator<unsigned int>(0U),
     boost::counting_iterator<unsigned int>(simpl_pgns.size()));
   std::vector<int> matching_simpl_pgn;
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const int ext_index = simplified_polygon_index(
         pwh.outer_boundary(),
@@ -167,7 +168,7 @@ void InsetState::simplify(const unsigned int target_points_per_inset)
 
   // Replace non-simplified polygons by their simplified counterparts
   unsigned int pgn_ctr = 0;
-  for (auto &gd : geo_divs_) {
+  for (auto &gd : geo_divs) {
     for (auto &pwh : *gd.ref_to_polygons_with_holes()) {
       const unsigned int match_outer = matching_simpl_pgn[pgn_ctr++];
       pwh.outer_boundary() = simpl_pgns[match_outer];
@@ -176,6 +177,11 @@ void InsetState::simplify(const unsigned int target_points_per_inset)
         *h = simpl_pgns[match_hole];
       }
     }
+    gd.update_area_and_bbox();
   }
+
+  // Update the flat coordinates here rather than in the next stage, which
+  // must not allocate memory
+  sync_flat_geo_divs();
   std::cerr << n_points() << " points after simplification." << std::endl;
 }
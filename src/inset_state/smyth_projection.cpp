@@ -37,10 +37,9 @@ Point point_before_smyth_craster_projection(
 void InsetState::revert_smyth_craster_projection()
 {
   // Specialise point_before_smyth_craster_projection with lx_ and ly_
-  std::function<Point(Point)> lambda =
-    [lx = lx_, ly = ly_](Point p1) {
-      return point_before_smyth_craster_projection(p1, lx, ly);
-    };
+  const auto lambda = [lx = lx_, ly = ly_](Point p1) {
+    return point_before_smyth_craster_projection(p1, lx, ly);
+  };
 
   // Apply `lambda` to all points
   transform_points(lambda);
@@ -51,11 +51,12 @@ void write_point_on_cairo_surface(cairo_t *cr, Point pt, color clr)
 
 void InsetState::write_polygon_points_on_cairo_surface(cairo_t *cr, color clr)
 {
+  sync_geo_divs();
   cairo_set_source_rgb(cr, clr.r, clr.g, clr.b);
   cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
   cairo_set_line_width(cr, 0.5);
   // Draw the shapes
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto ext_ring = pwh.outer_boundary();
 
@@ -116,7 +117,7 @@ double font_size(
     cairo_set_font_size(cr, fsize);
     cairo_text_extents_t extents;
     cairo_text_extents(cr, label, &extents);
-    const auto largest_pwh = gd.largest_polygon_with_holes();
+    const auto &largest_pwh = gd.largest_polygon_with_holes();
 
     // Bounding box of the label
     const CGAL::Bbox_2 bb(
@@ -147,10 +148,11 @@ void InsetState::write_polygons_to_cairo_surface(
   const bool colors,
   const bool plot_graticule)
 {
+  sync_geo_divs();
   cairo_set_line_width(cr, 1e-3 * std::min(lx_, ly_));
 
   // Draw the shapes
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const auto ext_ring = pwh.outer_boundary();
 
@@ -171,14 +173,14 @@ void InsetState::write_polygons_to_cairo_surface(
         }
       }
       if (colors || fill_polygons) {
-        if (is_input_target_area_missing(gd.id())) {
+        if (is_input_target_area_missing_[gd.id_index()]) {
 
           // Fill path with dark gray
           cairo_set_source_rgb(cr, 0.9375, 0.9375, 0.9375);
         } else if (colors) {
 
           // Get color
-          const auto col = color_at(gd.id());
+          const auto col = colors_[gd.id_index()].value();
 
           // Fill path
           cairo_set_source_rgb(
@@ -199,8 +201,8 @@ void InsetState::write_polygons_to_cairo_surface(
   }
 
   // Add labels
-  for (const auto &gd : geo_divs_) {
-    const auto label = label_at(gd.id());
+  for (const auto &gd : geo_divs()) {
+    const auto label = labels_[gd.id_index()];
     const auto label_char = label.c_str();
 
     // Go to a specific coordinate to place the label
@@ -49,8 +49,9 @@ void InsetState::write_polygons_to_eps(
   const bool fill_polygons,
   const bool colors)
 {
+  sync_geo_divs();
   eps_file << 0.001 * std::min(lx_, ly_) << " slw\n";
-  for (const auto &gd : geo_divs_) {
+  for (const auto &gd : geo_divs()) {
     for (const auto &pwh : gd.polygons_with_holes()) {
       const Polygon &ext_ring = pwh.outer_boundary();
 
@@ -80,7 +81,7 @@ void InsetState::write_polygons_to_eps(
         eps_file << "gsave\n";
 
         // Check whether target area was initially missing
-        if (is_input_target_area_missing(gd.id())) {
+        if (is_input_target_area_missing_[gd.id_index()]) {
 
           // Fill path with dark grey
           eps_file << "0.9375 0.9375 0.9375 srgb f\n";
@@ -88,7 +89,7 @@ void InsetState::write_polygons_to_eps(
         } else if (colors) {
 
           // Get color
-          Color col = color_at(gd.id());
+          Color col = colors_[gd.id_index()].value();
 
           // Fill path
           eps_file << col.eps() << "srgb f\n";
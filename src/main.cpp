@@ -1,5 +1,7 @@
 #include "cartogram_info.h"
 #include "constants.h"
+#include "fftw_threads.h"
+#include "fftw_wisdom.h"
 #include "parse_arguments.h"
 #include <chrono>
 #include <iostream>
@@ -45,6 +47,22 @@ int main(const int argc, const char *argv[])
   double min_polygon_area;
   bool qtdt_method;  // Use Quadtree-Delaunay triangulation
 
+  // Numerical method to integrate the equations of motion, and whether
+  // tiles of points may take time steps of different sizes
+  IntegrationMethod integration_method;
+  bool multi_rate;
+
+  // FFTW planner flag and file in which the plans are stored for later runs
+  unsigned int fftw_planner_flag;
+  std::string fftw_wisdom_file_name;
+  unsigned int n_threads;  // 0 if OpenMP chooses the number of threads
+
+  // Method to fill the grid cells with density
+  DensityRasterizer density_rasterizer;
+
+  // Method to find the Delaunay triangles that contain the points of the map
+  DelaunayLocator delaunay_locator;
+
   // Parse command-line arguments
   argparse::ArgumentParser arguments = parsed_arguments(
     argc,
@@ -56,6 +74,13 @@ int main(const int argc, const char *argv[])
     world,
     triangulation,
     qtdt_method,
+    integration_method,
+    multi_rate,
+    fftw_planner_flag,
+    fftw_wisdom_file_name,
+    n_threads,
+    density_rasterizer,
+    delaunay_locator,
     simplify,
     make_csv,
     output_equal_area,
@@ -72,6 +97,26 @@ int main(const int argc, const char *argv[])
   // that needs to be handled by functions called from main().
   CartogramInfo cart_info(world, visual_file_name);
 
+  // The same integrator is used for all insets and integrations. The insets
+  // also share the buffers and FFTW plans for the integration, which only
+  // need to be reallocated if the grid dimensions change.
+  const std::unique_ptr<Integrator> integrator =
+    make_integrator(integration_method, multi_rate);
+  const auto integration_workspace =
+    std::make_shared<IntegrationWorkspace>(fftw_planner_flag);
+
+  // Use the same number of threads for FFTW as for the other parallel loops.
+  // FFTW must know the number of threads before it makes any plan or
+  // imports wisdom.
+  std::cerr << "Using " << init_fftw_threads(n_threads) << " threads"
+            << std::endl;
+
+  // Reuse the FFTW plans that earlier runs found for the same transforms
+  if (import_fftw_wisdom(fftw_wisdom_file_name)) {
+    std::cerr << "Using FFTW wisdom from " << fftw_wisdom_file_name
+              << std::endl;
+  }
+
   // Determine name of input map and store it
   std::string map_name = geo_file_name;
   if (map_name.find_last_of("/\\") != std::string::npos) {
@@ -210,6 +255,7 @@ int main(const int argc, const char *argv[])
                 << std::endl;
     }
     inset_state.set_inset_name(inset_name);
+    inset_state.set_integration_workspace(integration_workspace);
 
     // Rescale map to fit into a rectangular box [0, lx] * [0, ly]
     inset_state.rescale_map(max_n_grid_rows_or_cols, cart_info.is_world_map());
@@ -225,7 +271,7 @@ int main(const int argc, const char *argv[])
     const unsigned int ly = inset_state.ly();
     inset_state.ref_to_rho_init()->allocate(lx, ly);
     inset_state.ref_to_rho_ft()->allocate(lx, ly);
-    inset_state.make_fftw_plans_for_rho();
+    inset_state.make_fftw_plans_for_rho(fftw_planner_flag);
     inset_state.initialize_cum_proj();
     inset_state.set_area_errors();
 
@@ -328,21 +374,19 @@ int main(const int argc, const char *argv[])
 
       // Track time needed for fill_with_density()
       time_point start_fill_density = clock_time::now();
-      inset_state.fill_with_density(plot_density);
+      inset_state.fill_with_density(plot_density, density_rasterizer);
       time_point end_fill_density = clock_time::now();
       duration_fill_density +=
         inMilliseconds(end_fill_density - start_fill_density);
-      if (blur_width > 0.0) {
-        inset_state.blur_density(blur_width, plot_density);
-      }
       if (plot_intersections) {
         inset_state.write_intersections_to_eps(intersections_resolution);
       }
       time_point start_flatten_density = clock_time::now();
+      inset_state.prepare_velocity_field(blur_width, plot_density);
       if (qtdt_method) {
-        inset_state.flatten_density_with_node_vertices();
+        inset_state.flatten_density_with_node_vertices(*integrator);
       } else {
-        inset_state.flatten_density();
+        inset_state.flatten_density(*integrator);
       }
       time_point end_flatten_density = clock_time::now();
       duration_flatten_density +=
@@ -350,14 +394,21 @@ int main(const int argc, const char *argv[])
       if (qtdt_method) {
         if (simplify) {
           time_point start_densify = clock_time::now();
-          inset_state.densify_geo_divs_using_delaunay_t();
+          inset_state.densify_geo_divs_using_delaunay_t(delaunay_locator);
           time_point end_densify = clock_time::now();
           duration_densification +=
             inMilliseconds(end_densify - start_densify);
         }
 
         // Project using the Delaunay triangulation
-        inset_state.project_with_delaunay_t();
+        inset_state.project_with_delaunay_t(delaunay_locator);
+        if (output_to_stdout) {
+
+          // Compose the projection of the original coordinates with the
+          // projection of this integration, so that the triangulation is
+          // not needed anymore after the integration
+          inset_state.project_with_delaunay_t(delaunay_locator, true);
+        }
       } else if (triangulation) {
         time_point start_densify = clock_time::now();
 
@@ -389,8 +440,9 @@ int main(const int argc, const char *argv[])
 
       // Update area errors
       inset_state.set_area_errors();
-      std::cerr << "max. area err: " << inset_state.max_area_error().value
-                << ", GeoDiv: " << inset_state.max_area_error().geo_div
+      const max_area_error_info max_area_err = inset_state.max_area_error();
+      std::cerr << "max. area err: " << max_area_err.value
+                << ", GeoDiv: " << inset_state.id_at(max_area_err.geo_div)
                 << "\nProgress: "
                 << progress + (inset_max_frac / n_predicted_integrations)
                 << std::endl
@@ -433,13 +485,11 @@ int main(const int argc, const char *argv[])
       inset_state.normalize_inset_area(cart_info.cart_total_target_area());
     }
 
-    if (output_to_stdout) {
-      if (qtdt_method) {
-        inset_state.project_with_proj_sequence();
-      } else {
-        inset_state.fill_graticule_diagonals(true);
-        inset_state.project_with_cum_proj();
-      }
+    // With the Quadtree-Delaunay method, the original coordinates have
+    // already been projected after each integration
+    if (output_to_stdout && !qtdt_method) {
+      inset_state.fill_graticule_diagonals(true);
+      inset_state.project_with_cum_proj();
     }
 
     // Clean up after finishing all Fourier transforms for this inset
@@ -448,6 +498,15 @@ int main(const int argc, const char *argv[])
     inset_state.ref_to_rho_ft()->free();
   }  // End of loop over insets
 
+  // Save the plans for later runs. FFTW_ESTIMATE does not produce plans
+  // that are worth saving.
+  if (
+    fftw_planner_flag != FFTW_ESTIMATE && !fftw_wisdom_file_name.empty() &&
+    !export_fftw_wisdom(fftw_wisdom_file_name)) {
+    std::cerr << "WARNING: Could not write FFTW wisdom to "
+              << fftw_wisdom_file_name << std::endl;
+  }
+
   // Shift insets so that they do not overlap
   cart_info.shift_insets_to_target_position();
 
@@ -486,6 +545,9 @@ int main(const int argc, const char *argv[])
             << " ms" << std::endl;
   std::cerr << "Fill with Density Time: " << duration_fill_density.count()
             << " ms" << std::endl;
+  std::cerr << "Integration Workspace Peak Memory: "
+            << integration_workspace->peak_memory() / (1024.0 * 1024.0)
+            << " MiB" << std::endl;
   std::cerr << "--------------------------------" << std::endl;
   std::cerr << "Total Time: " << inMilliseconds(end_main - start_main).count()
             << " ms" << std::endl;
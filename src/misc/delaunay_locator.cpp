@@ -0,0 +1,108 @@
+#include "delaunay_locator.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+Face_handle located_face(
+  const Delaunay &dt,
+  const Point &p,
+  Face_handle hint,
+  unsigned long &n_steps)
+{
+  if (dt.dimension() < 2) {
+    return dt.locate(p);
+  }
+  Face_handle fh = hint;
+  if (fh == Face_handle() || dt.is_infinite(fh)) {
+    const Face_handle inf = dt.infinite_face();
+    fh = inf->neighbor(inf->index(dt.infinite_vertex()));
+  }
+
+  // The faces are oriented counterclockwise. Hence, p is outside the face
+  // if it is to the right of one of the edges. We move to the neighbour
+  // across that edge. The walk terminates in a Delaunay triangulation, but
+  // rounding errors in the orientation tests could make it cycle. Therefore,
+  // we let CGAL finish the search if the walk takes more steps than there
+  // are faces, or if p is outside the convex hull.
+  const std::size_t max_steps = dt.number_of_faces();
+  for (std::size_t step = 0; step <= max_steps; ++step) {
+    int exit_edge = -1;
+    for (int i = 0; i < 3 && exit_edge < 0; ++i) {
+      if (
+        CGAL::orientation(
+          fh->vertex(Delaunay::ccw(i))->point(),
+          fh->vertex(Delaunay::cw(i))->point(),
+          p) == CGAL::RIGHT_TURN) {
+        exit_edge = i;
+      }
+    }
+    if (exit_edge < 0) {
+      return fh;
+    }
+    const Face_handle next = fh->neighbor(exit_edge);
+    if (dt.is_infinite(next)) {
+      break;
+    }
+    fh = next;
+    ++n_steps;
+  }
+  return dt.locate(p, fh);
+}
+
+// Distance along a Hilbert curve through an n-times-n grid, where n is a
+// power of 2, to the cell (x, y). Adapted from
+// https://en.wikipedia.org/wiki/Hilbert_curve
+static std::uint64_t hilbert_distance(
+  const std::uint32_t n,
+  std::uint32_t x,
+  std::uint32_t y)
+{
+  std::uint64_t d = 0;
+  for (std::uint32_t s = n / 2; s > 0; s /= 2) {
+    const std::uint32_t rx = (x & s) > 0;
+    const std::uint32_t ry = (y & s) > 0;
+    d += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+
+    // Rotate the quadrant so that the curve inside it starts at its origin
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+std::vector<std::size_t> hilbert_order(
+  const std::vector<XYPoint> &points,
+  const unsigned int lx,
+  const unsigned int ly)
+{
+  // The curve runs through cells that are a quarter of a graticule cell
+  // wide, which is finer than the triangles of the quadtree
+  constexpr std::uint32_t cells_per_graticule_cell = 4;
+  std::uint32_t n = 1;
+  while (n < cells_per_graticule_cell * std::max(lx, ly)) {
+    n *= 2;
+  }
+  std::vector<std::pair<std::uint64_t, std::size_t> > keys(points.size());
+#pragma omp parallel for default(none) shared(points, keys, n)
+  for (std::size_t k = 0; k < points.size(); ++k) {
+    const auto cell = [n](const double coord) {
+      return static_cast<std::uint32_t>(std::clamp(
+        coord * cells_per_graticule_cell,
+        0.0,
+        static_cast<double>(n - 1)));
+    };
+    keys[k] = {hilbert_distance(n, cell(points[k].x), cell(points[k].y)), k};
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<std::size_t> order;
+  order.reserve(keys.size());
+  for (const auto &key : keys) {
+    order.push_back(key.second);
+  }
+  return order;
+}
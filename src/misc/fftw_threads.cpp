@@ -0,0 +1,32 @@
+#include "fftw_threads.h"
+#include <fftw3.h>
+#include <iostream>
+#include <omp.h>
+
+// Number of threads with which FFTW makes plans
+static int fftw_n_threads = 1;
+
+int init_fftw_threads(const unsigned int n_threads)
+{
+  if (n_threads > 0) {
+    omp_set_num_threads(static_cast<int>(n_threads));
+  }
+  const int n = omp_get_max_threads();
+
+  // HAVE_FFTW_THREADS is defined by CMake if it finds libfftw3_omp or
+  // libfftw3_threads
+#ifdef HAVE_FFTW_THREADS
+  if (fftw_init_threads() == 0) {
+    std::cerr << "WARNING: Could not initialize FFTW threads" << std::endl;
+    return n;
+  }
+  fftw_plan_with_nthreads(n);
+  fftw_n_threads = n;
+#endif
+  return n;
+}
+
+bool fftw_is_multithreaded()
+{
+  return fftw_n_threads > 1;
+}
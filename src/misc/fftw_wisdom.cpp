@@ -0,0 +1,61 @@
+#include "fftw_wisdom.h"
+#include <cstdlib>
+#include <fftw3.h>
+#include <filesystem>
+#include <system_error>
+
+std::string default_fftw_wisdom_file_name()
+{
+  std::filesystem::path cache_dir;
+  if (const char *xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+      xdg_cache_home != nullptr && *xdg_cache_home != '\0') {
+    cache_dir = xdg_cache_home;
+  } else if (const char *home = std::getenv("HOME");
+             home != nullptr && *home != '\0') {
+    cache_dir = std::filesystem::path(home) / ".cache";
+  } else {
+    return "";
+  }
+  return (cache_dir / "cartogram" / "fftw_wisdom").string();
+}
+
+bool import_fftw_wisdom(const std::string &file_name)
+{
+  if (file_name.empty() || !std::filesystem::exists(file_name)) {
+    return false;
+  }
+  return fftw_import_wisdom_from_filename(file_name.c_str()) != 0;
+}
+
+bool export_fftw_wisdom(const std::string &file_name)
+{
+  if (file_name.empty()) {
+    return false;
+  }
+
+  // Create the cache directory if it does not exist yet
+  const std::filesystem::path dir =
+    std::filesystem::path(file_name).parent_path();
+  if (!dir.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      return false;
+    }
+  }
+  return fftw_export_wisdom_to_filename(file_name.c_str()) != 0;
+}
+
+bool fftw_planner_flag_from_name(const std::string &name, unsigned int &flag)
+{
+  if (name == "estimate") {
+    flag = FFTW_ESTIMATE;
+  } else if (name == "measure") {
+    flag = FFTW_MEASURE;
+  } else if (name == "patient") {
+    flag = FFTW_PATIENT;
+  } else {
+    return false;
+  }
+  return true;
+}
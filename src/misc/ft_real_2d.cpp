@@ -1,4 +1,5 @@
 #include "ft_real_2d.h"
+#include <algorithm>
 #include <fftw3.h>
 #include <iostream>
 
@@ -33,11 +34,13 @@ void FTReal2d::free()
   return;
 }
 
-void FTReal2d::make_fftw_plan(fftw_r2r_kind kind0, fftw_r2r_kind kind1)
+void FTReal2d::make_fftw_plan(fftw_r2r_kind kind0,
+                              fftw_r2r_kind kind1,
+                              const unsigned int planner_flag)
 {
   plan_ = fftw_plan_r2r_2d(lx_, ly_,
                            array_, array_,
-                           kind0, kind1, FFTW_ESTIMATE);
+                           kind0, kind1, planner_flag);
   return;
 }
 
@@ -63,3 +66,27 @@ double FTReal2d::operator() (const unsigned int i,
 {
   return array_[i*ly_ + j];
 }
+
+bool is_fft_friendly(unsigned int n)
+{
+  if (n == 0) {
+    return false;
+  }
+  for (const unsigned int factor : {2, 3, 5, 7}) {
+    while (n % factor == 0) {
+      n /= factor;
+    }
+  }
+  return n == 1;
+}
+
+unsigned int fft_friendly_size(const unsigned int n)
+{
+  // FFT-friendly integers are dense enough that a linear search is fast.
+  // For example, there are 38 of them between 512 and 1024.
+  unsigned int m = std::max(n, 1U);
+  while (!is_fft_friendly(m)) {
+    ++m;
+  }
+  return m;
+}
@@ -1,5 +1,6 @@
 #include "parse_arguments.h"
 #include "constants.h"
+#include "fftw_wisdom.h"
 #include <iostream>
 #include <string>
 
@@ -13,6 +14,13 @@ argparse::ArgumentParser parsed_arguments(
   bool &world,
   bool &triangulation,
   bool &qtdt_method,
+  IntegrationMethod &integration_method,
+  bool &multi_rate,
+  unsigned int &fftw_planner_flag,
+  std::string &fftw_wisdom_file_name,
+  unsigned int &n_threads,
+  DensityRasterizer &density_rasterizer,
+  DelaunayLocator &delaunay_locator,
   bool &simplify,
   bool &make_csv,
   bool &output_equal_area,
@@ -45,7 +53,8 @@ argparse::ArgumentParser parsed_arguments(
     .default_value(default_long_graticule_length)
     .scan<'u', unsigned int>()
     .help(
-      "Integer: Number of grid cells along longer Cartesian coordinate axis");
+      "Integer: Number of grid cells along longer Cartesian coordinate axis, "
+      "of the form 2^a * 3^b * 5^c * 7^d");
 
   // Optional boolean arguments
   arguments.add_argument("-w", "--world")
@@ -84,6 +93,44 @@ argparse::ArgumentParser parsed_arguments(
     .help("Boolean: Use Quadtree-Delaunay Triangulation Method?")
     .default_value(false)
     .implicit_value(true);
+  arguments.add_argument("--integrator")
+    .help(
+      "String: Integrator for the equations of motion, \"midpoint\" or "
+      "\"dormand_prince\"")
+    .default_value(std::string("midpoint"));
+  arguments.add_argument("--multi_rate")
+    .help("Boolean: Let each tile of points choose its own time steps?")
+    .default_value(false)
+    .implicit_value(true);
+  arguments.add_argument("--fftw_planner")
+    .help(
+      "String: Rigor of the FFTW planner, \"estimate\", \"measure\" or "
+      "\"patient\". Plans found with more rigor are stored in the wisdom "
+      "file and reused in later runs.")
+    .default_value(std::string("estimate"));
+  arguments.add_argument("--fftw_wisdom_file")
+    .help("String: File in which FFTW wisdom is stored (empty: none)")
+    .default_value(default_fftw_wisdom_file_name());
+  arguments.add_argument("--threads")
+    .help(
+      "Integer: Number of threads for OpenMP and FFTW [default: "
+      "OMP_NUM_THREADS or number of cores]")
+    .default_value(0U)
+    .scan<'u', unsigned int>();
+  arguments.add_argument("--density_rasterizer")
+    .help(
+      "String: Method to fill the grid cells with density, \"scanline\" "
+      "(rays through every row), \"adaptive\" (many rays only in cells "
+      "crossed by a boundary) or \"exact\" (exact area of each region in "
+      "each cell)")
+    .default_value(std::string("scanline"));
+  arguments.add_argument("--delaunay_locator")
+    .help(
+      "String: How the Quadtree-Delaunay method finds the triangle of each "
+      "point, \"walk\" (from the triangle of the previous point), "
+      "\"hilbert\" (as walk, visiting the points along a Hilbert curve) or "
+      "\"cold\" (every search from the same triangle)")
+    .default_value(std::string("walk"));
   arguments.add_argument("-s", "--simplify")
     .help("Boolean: Shall the polygons be simplified?")
     .default_value(false)
@@ -147,6 +194,65 @@ argparse::ArgumentParser parsed_arguments(
   world = arguments.get<bool>("-w");
   triangulation = arguments.get<bool>("-t");
   qtdt_method = arguments.get<bool>("-Q");
+
+  // Set integrator
+  const std::string integrator = arguments.get<std::string>("--integrator");
+  if (integrator == "midpoint") {
+    integration_method = IntegrationMethod::midpoint;
+  } else if (integrator == "dormand_prince") {
+    integration_method = IntegrationMethod::dormand_prince;
+  } else {
+    std::cerr << "ERROR: Unknown integrator " << integrator << "!\n";
+    std::cerr << "Choose \"midpoint\" or \"dormand_prince\"." << std::endl;
+    std::cerr << arguments << std::endl;
+    _Exit(19);
+  }
+  multi_rate = arguments.get<bool>("--multi_rate");
+
+  // Set FFTW planner
+  const std::string fftw_planner = arguments.get<std::string>("--fftw_planner");
+  if (!fftw_planner_flag_from_name(fftw_planner, fftw_planner_flag)) {
+    std::cerr << "ERROR: Unknown FFTW planner " << fftw_planner << "!\n";
+    std::cerr << "Choose \"estimate\", \"measure\" or \"patient\"."
+              << std::endl;
+    std::cerr << arguments << std::endl;
+    _Exit(20);
+  }
+  fftw_wisdom_file_name = arguments.get<std::string>("--fftw_wisdom_file");
+  n_threads = arguments.get<unsigned int>("--threads");
+
+  // Set density rasterizer
+  const std::string rasterizer =
+    arguments.get<std::string>("--density_rasterizer");
+  if (rasterizer == "scanline") {
+    density_rasterizer = DensityRasterizer::scanline;
+  } else if (rasterizer == "adaptive") {
+    density_rasterizer = DensityRasterizer::adaptive;
+  } else if (rasterizer == "exact") {
+    density_rasterizer = DensityRasterizer::exact;
+  } else {
+    std::cerr << "ERROR: Unknown density rasterizer " << rasterizer << "!\n";
+    std::cerr << "Choose \"scanline\", \"adaptive\" or \"exact\"."
+              << std::endl;
+    std::cerr << arguments << std::endl;
+    _Exit(21);
+  }
+
+  // Set point location in the Delaunay triangulations
+  const std::string locator =
+    arguments.get<std::string>("--delaunay_locator");
+  if (locator == "walk") {
+    delaunay_locator = DelaunayLocator::walk;
+  } else if (locator == "hilbert") {
+    delaunay_locator = DelaunayLocator::hilbert;
+  } else if (locator == "cold") {
+    delaunay_locator = DelaunayLocator::cold;
+  } else {
+    std::cerr << "ERROR: Unknown Delaunay locator " << locator << "!\n";
+    std::cerr << "Choose \"walk\", \"hilbert\" or \"cold\"." << std::endl;
+    std::cerr << arguments << std::endl;
+    _Exit(22);
+  }
   simplify = arguments.get<bool>("-s");
   remove_tiny_polygons = arguments.get<bool>("-r");
   minimum_polygon_area = arguments.get<double>("-M");
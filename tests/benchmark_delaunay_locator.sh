@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+
+# Compare the point location methods of the Quadtree-Delaunay triangulation
+# (cold, walk and hilbert) on every map in sample_data:
+#   ./benchmark_delaunay_locator.sh <cartogram> [options]
+# Any further options are passed to all runs, e.g. -s. For each map and
+# visual-variable file, the script prints the mean number of triangles that
+# the search for a point crosses when projecting the map (and, with -s, when
+# densifying it), and the total time. The cold method starts every search
+# from the same triangle, as CGAL's locate() without a hint does.
+
+if [ $# -lt 1 ]; then
+  printf "Usage: $0 <cartogram> [cartogram options]\n"
+  exit 1
+fi
+binary="$1"
+shift 1
+cli="$@"
+
+# Mean of the "... steps per point" values in lines that start with $1
+mean_steps()
+{
+  grep "^$1" <<< "${output}" |
+    awk '{ s += $(NF - 3); n++ } END { if (n) printf "%.2f", s / n }'
+}
+
+# Run the binary once and print a summary line
+run_binary()
+{
+  local label="$1"
+  shift 1
+  output=$("${binary}" ${map} ${csv} -Q ${cli} "$@" 2>&1)
+  if ! grep -Fxq "Progress: 1" <<< "${output}"; then
+    printf "  %-8s integration did not finish\n" "${label}"
+    return
+  fi
+  project_steps=$(mean_steps "Delaunay point location: ")
+  densify_steps=$(mean_steps "Delaunay point location for densification: ")
+  total_ms=$(grep "Total Time" <<< "${output}" | awk '{ print $3 }')
+  printf "  %-8s steps per point: projection %8s, densification %8s, " \
+    "${label}" "${project_steps:--}" "${densify_steps:--}"
+  printf "total %8s ms\n" "${total_ms}"
+}
+
+printf "Options: ${cli}\n"
+for folder in ../sample_data/*; do
+  if [[ -d "${folder}" && "${folder}" != *"sandbox"* ]]; then
+    for map in ${folder}/*.*json; do
+      for csv in ${folder}/*.csv; do
+        printf "\n${map##*/} with ${csv##*/}\n"
+        for locator in cold walk hilbert; do
+          run_binary "${locator}" --delaunay_locator "${locator}"
+        done
+      done
+    done
+  fi
+done
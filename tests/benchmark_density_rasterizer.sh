@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+# Compare the rasterizers of fill_with_density() (scanline, adaptive and
+# exact) on every map in sample_data:
+#   ./benchmark_density_rasterizer.sh <cartogram> [options]
+# Any further options are passed to all runs, e.g. -N 1024. For each map and
+# visual-variable file, the script prints the number of integrations, the
+# final maximum area error, the time spent filling the density and the total
+# time. The adaptive rasterizer also reports the share of supersampled
+# cells.
+
+if [ $# -lt 1 ]; then
+  printf "Usage: $0 <cartogram> [cartogram options]\n"
+  exit 1
+fi
+binary="$1"
+shift 1
+cli="$@"
+
+# Run the binary once and print a summary line
+run_binary()
+{
+  local label="$1"
+  shift 1
+  output=$("${binary}" ${map} ${csv} ${cli} "$@" 2>&1)
+  if ! grep -Fxq "Progress: 1" <<< "${output}"; then
+    printf "  %-9s integration did not finish\n" "${label}"
+    return
+  fi
+  integrations=$(grep -c "^blur_width = " <<< "${output}")
+  area_error=$(grep "^max. area err: " <<< "${output}" | tail -n 1 |
+               awk '{ print $4 }' | tr -d ',')
+  fill_ms=$(grep "Fill with Density Time" <<< "${output}" |
+            awk '{ print $5 }')
+  total_ms=$(grep "Total Time" <<< "${output}" | awk '{ print $3 }')
+  supersampled=$(grep "^Supersampling " <<< "${output}" | tail -n 1 |
+                 grep -oE "\([0-9.e+-]+%\)")
+  printf "  %-9s %3s integrations, max. area error %-12s " \
+    "${label}" "${integrations}" "${area_error}"
+  printf "fill_with_density() %8s ms, total %8s ms %s\n" \
+    "${fill_ms}" "${total_ms}" "${supersampled}"
+}
+
+printf "Options: ${cli}\n"
+for folder in ../sample_data/*; do
+  if [[ -d "${folder}" && "${folder}" != *"sandbox"* ]]; then
+    for map in ${folder}/*.*json; do
+      for csv in ${folder}/*.csv; do
+        printf "\n${map##*/} with ${csv##*/}\n"
+        for rasterizer in scanline adaptive exact; do
+          run_binary "${rasterizer}" --density_rasterizer "${rasterizer}"
+        done
+      done
+    done
+  fi
+done
@@ -0,0 +1,95 @@
+// Benchmark of the two-dimensional FFTW transforms that cartogram uses, for
+// each rigor of the FFTW planner. For every grid size, the program reports
+// the time needed to make the plan and the mean time of one transform:
+//   REDFT10 x REDFT10  forward transform of the density
+//   REDFT01 x REDFT01  backward transform of the density
+//   RODFT01 x REDFT01  x-component of the flux
+//   REDFT01 x RODFT01  y-component of the flux
+// Usage: benchmark_fftw_planner [lx ly]...
+// Without arguments, the sizes 512x256 and 1024x512 are used. The wisdom
+// is forgotten between planner levels so that each level plans from scratch.
+
+#include <chrono>
+#include <cstdlib>
+#include <fftw3.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct transform {
+  std::string name;
+  fftw_r2r_kind kind0, kind1;
+};
+
+struct planner {
+  std::string name;
+  unsigned int flag;
+};
+
+double milliseconds_since(const std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+int main(const int argc, const char *argv[])
+{
+  std::vector<std::pair<int, int> > sizes;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    sizes.emplace_back(std::atoi(argv[i]), std::atoi(argv[i + 1]));
+  }
+  if (sizes.empty()) {
+    sizes = {{512, 256}, {1024, 512}};
+  }
+  const std::vector<transform> transforms = {
+    {"REDFT10 x REDFT10", FFTW_REDFT10, FFTW_REDFT10},
+    {"REDFT01 x REDFT01", FFTW_REDFT01, FFTW_REDFT01},
+    {"RODFT01 x REDFT01", FFTW_RODFT01, FFTW_REDFT01},
+    {"REDFT01 x RODFT01", FFTW_REDFT01, FFTW_RODFT01}};
+  const std::vector<planner> planners = {
+    {"estimate", FFTW_ESTIMATE},
+    {"measure", FFTW_MEASURE},
+    {"patient", FFTW_PATIENT}};
+
+  // Number of transforms over which the execution time is averaged
+  const unsigned int n_repeats = 20;
+  std::cout << std::setw(11) << "size" << std::setw(20) << "transform"
+            << std::setw(10) << "planner" << std::setw(14) << "plan [ms]"
+            << std::setw(16) << "execute [ms]" << std::endl;
+  for (const auto &[lx, ly] : sizes) {
+    const std::size_t n = static_cast<std::size_t>(lx) * ly;
+    auto *in = static_cast<double *>(fftw_malloc(n * sizeof(double)));
+    auto *out = static_cast<double *>(fftw_malloc(n * sizeof(double)));
+    for (const transform &tr : transforms) {
+      for (const planner &pl : planners) {
+        fftw_forget_wisdom();
+        auto start = std::chrono::steady_clock::now();
+        const fftw_plan plan =
+          fftw_plan_r2r_2d(lx, ly, in, out, tr.kind0, tr.kind1, pl.flag);
+        const double plan_ms = milliseconds_since(start);
+
+        // The planner may have overwritten the input
+        for (std::size_t k = 0; k < n; ++k) {
+          in[k] = static_cast<double>(k % 97) / 97.0;
+        }
+        start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < n_repeats; ++r) {
+          fftw_execute(plan);
+        }
+        const double execute_ms = milliseconds_since(start) / n_repeats;
+        fftw_destroy_plan(plan);
+        std::cout << std::setw(11)
+                  << (std::to_string(lx) + "x" + std::to_string(ly))
+                  << std::setw(20) << tr.name << std::setw(10) << pl.name
+                  << std::setw(14) << std::fixed << std::setprecision(2)
+                  << plan_ms << std::setw(16) << execute_ms << std::endl;
+      }
+    }
+    fftw_free(in);
+    fftw_free(out);
+  }
+  return EXIT_SUCCESS;
+}
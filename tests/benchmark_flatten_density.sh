@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+# Compare the time spent in flatten_density() by two cartogram binaries on
+# the same map, e.g. before and after a change to the integrator:
+#   ./benchmark_flatten_density.sh <old_cartogram> <new_cartogram> [options]
+# Any further options are passed to both binaries. Options that only one
+# binary understands can be set with the variables OPTIONS_A and OPTIONS_B,
+# e.g. OPTIONS_B="--integrator dormand_prince" if cartogram_a predates the
+# --integrator option. By default, the Russia map is used because its many
+# small federal subjects require many integration steps. Another map can be
+# chosen with the variables MAP and CSV.
+# Binaries that do not print "Integrator ..." statistics (e.g. the baseline)
+# only report the total flatten_density() time. Their steps, rejected steps,
+# velocity evaluations and time per step are printed as n/a.
+
+if [ $# -lt 2 ]; then
+  printf "Usage: $0 <cartogram_a> <cartogram_b> [cartogram options]\n"
+  exit 1
+fi
+binary_a="$1"
+binary_b="$2"
+shift 2
+cli="$@"
+
+folder="../sample_data/russia_by_federal_subject_since_2008"
+map="${MAP:-${folder}/russia_by_federal_subject_since_2008.geojson}"
+csv="${CSV:-${folder}/russia_population_2010.csv}"
+repeats="${REPEATS:-3}"
+
+# Run a binary with the given extra options and print the total
+# flatten_density() time as well as the mean time per integration step
+run_binary()
+{
+  local binary="$1"
+  local options="$2"
+  for run in $(seq 1 ${repeats}); do
+    output=$("${binary}" ${map} ${csv} ${cli} ${options} 2>&1)
+    if ! grep -Fxq "Progress: 1" <<< "${output}"; then
+      printf "${binary}: integration did not finish\n"
+      return 1
+    fi
+    flatten_ms=$(grep "Flatten Density Time" <<< "${output}" |
+                 awk '{ print $4 }')
+    stats=$(grep "^Integrator " <<< "${output}")
+    if [ -z "${stats}" ]; then
+      printf "${binary} (run ${run}): flatten_density() ${flatten_ms} ms, "
+      printf "n/a steps, n/a rejected, n/a velocity evaluations, "
+      printf "n/a ms per step\n"
+      continue
+    fi
+    steps=$(grep -oE "[0-9]+ steps" <<< "${stats}" |
+            awk '{ n += $1 } END { print n }')
+    rejected=$(grep -oE "[0-9]+ rejected" <<< "${stats}" |
+               awk '{ n += $1 } END { print n }')
+    evaluations=$(grep -oE "[0-9.e+-]+ velocity evaluations" <<< "${stats}" |
+                  awk '{ n += $1 } END { print n }')
+    step_ms=$(grep -oE "[0-9.e+-]+ ms," <<< "${stats}" |
+              awk -v steps="${steps}" '{ ms += $1 }
+                END { if (steps > 0) printf "%.3f", ms / steps }')
+    printf "${binary} (run ${run}): flatten_density() ${flatten_ms} ms, "
+    printf "${steps} steps, ${rejected} rejected, "
+    printf "${evaluations} velocity evaluations, ${step_ms} ms per step\n"
+  done
+}
+
+printf "Map: ${map}\nCSV: ${csv}\nOptions: ${cli}\n"
+printf "Options of ${binary_a}: ${OPTIONS_A}\n"
+printf "Options of ${binary_b}: ${OPTIONS_B}\n\n"
+run_binary "${binary_a}" "${OPTIONS_A}" || exit 1
+run_binary "${binary_b}" "${OPTIONS_B}" || exit 1
@@ -124,6 +124,30 @@ countries=0
 total_tests=0
 failed=0
 
+# Build and run a test program in ../build, e.g. test_bilinear_interpolator.
+# Each program counts as one test.
+run_unit_test()
+{
+  local name="$1"
+  total_tests=$((total_tests+1))
+  printf "Running ${name}\n" | tee -a "${results_file}" | color $blue
+  if make "${name}" -C ../build > ${tmp_file} 2>&1 &&
+     ../build/bin/${name} >> ${tmp_file} 2>&1; then
+    tail -n 1 ${tmp_file} | tee -a "${results_file}"
+    printf "== PASSED ==\n\n" | tee -a "${results_file}" | color $green
+  else
+    tail -n 20 ${tmp_file} | tee -a "${results_file}"
+    printf "== FAILED ==\n\n" | tee -a "${results_file}" | color $red
+    printf "\n${name}\n" >> failed_tmp.txt
+    failed=$((failed+1))
+  fi
+  > ${tmp_file}
+}
+
+printf " -------- Unit tests\n\n" | tee -a "${results_file}" | color $magenta
+run_unit_test test_bilinear_interpolator
+run_unit_test test_allocations
+
 # Iterating through folders in ..sample_data/
 for folder in ../sample_data/*; do
   if [[ -d "${folder}" && "${folder}" != *"sandbox"* ]]; then
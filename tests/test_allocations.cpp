@@ -0,0 +1,372 @@
+// Test that an integration does not allocate heap memory outside
+// densification and simplification. The program replaces the global
+// operator new and counts the allocations in each stage of an integration of
+// a small synthetic map, for each density rasterizer and integrator. Each
+// measured integration follows a warm-up integration, in which the buffers
+// that later integrations reuse are allocated.
+// The target areas equal the initial areas, so that the map does not move.
+// Hence, the buffers whose sizes depend on the positions of the points
+// (e.g., the intersections of the polygons with the rays) need not grow
+// between the two integrations, and every allocation that is counted would
+// happen in every integration of a real map.
+// Memory that FFTW and OpenMP allocate with malloc() is not counted. The
+// default method of main(), which uses neither densification nor
+// simplification, is tested. With triangulation, densify_geo_divs() and
+// simplify() rebuild the polygons in every integration.
+// Usage: test_allocations
+
+#include "fftw_threads.h"
+#include "inset_state.h"
+#include "integrator.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <numbers>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static std::atomic<unsigned long> n_allocations = 0;
+
+static void *allocate(const std::size_t size) noexcept
+{
+  ++n_allocations;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+static void *allocate(std::size_t size, const std::align_val_t al) noexcept
+{
+  ++n_allocations;
+
+  // The size passed to aligned_alloc() must be a multiple of the alignment
+  const auto alignment = static_cast<std::size_t>(al);
+  size = (size + alignment - 1) / alignment * alignment;
+  return std::aligned_alloc(alignment, size == 0 ? alignment : size);
+}
+
+void *operator new(const std::size_t size)
+{
+  if (void *p = allocate(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](const std::size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(const std::size_t size, const std::align_val_t al)
+{
+  if (void *p = allocate(size, al)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](const std::size_t size, const std::align_val_t al)
+{
+  return operator new(size, al);
+}
+
+void *operator new(const std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void *operator new[](const std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void *operator new(
+  const std::size_t size,
+  const std::align_val_t al,
+  const std::nothrow_t &) noexcept
+{
+  return allocate(size, al);
+}
+
+void *operator new[](
+  const std::size_t size,
+  const std::align_val_t al,
+  const std::nothrow_t &) noexcept
+{
+  return allocate(size, al);
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](
+  void *p,
+  std::align_val_t,
+  const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+// Number of allocations in one stage of an integration
+struct stage_allocations {
+  std::string_view stage;
+  unsigned long n;
+};
+
+// Function to run one stage and append the number of allocations during the
+// stage to counts. Appending may allocate, but only after the stage.
+template <typename F>
+static void count_allocations(
+  const std::string_view stage,
+  F run_stage,
+  std::vector<stage_allocations> &counts)
+{
+  const unsigned long n_before = n_allocations;
+  run_stage();
+  const unsigned long n = n_allocations - n_before;
+  counts.push_back({stage, n});
+}
+
+// Function to run one integration in the same order of stages as main()
+// without triangulation, densification and simplification
+static std::vector<stage_allocations> integrate(
+  InsetState &inset_state,
+  const Integrator &integrator,
+  const DensityRasterizer rasterizer)
+{
+  std::vector<stage_allocations> counts;
+  counts.reserve(16);
+  const double blur_width =
+    std::pow(2.0, 5 - int(inset_state.n_finished_integrations()));
+  double max_area_error = 0.0;
+  double area_drift = 0.0;
+  count_allocations(
+    "max_area_error",
+    [&] {
+      max_area_error = inset_state.max_area_error().value;
+      area_drift = inset_state.area_drift();
+    },
+    counts);
+  count_allocations(
+    "fill_with_density",
+    [&] { inset_state.fill_with_density(false, rasterizer); },
+    counts);
+  count_allocations(
+    "prepare_velocity_field",
+    [&] { inset_state.prepare_velocity_field(blur_width, false); },
+    counts);
+  count_allocations(
+    "flatten_density",
+    [&] { inset_state.flatten_density(integrator); },
+    counts);
+  count_allocations("project", [&] { inset_state.project(); }, counts);
+  count_allocations(
+    "increment_integration",
+    [&] { inset_state.increment_integration(); },
+    counts);
+  count_allocations(
+    "area_drift",
+    [&] { area_drift = inset_state.area_drift(); },
+    counts);
+  count_allocations(
+    "set_area_errors",
+    [&] { inset_state.set_area_errors(); },
+    counts);
+  count_allocations(
+    "max_area_error",
+    [&] { max_area_error = inset_state.max_area_error().value; },
+    counts);
+  std::cerr << "max. area err: " << max_area_error
+            << ", area drift: " << area_drift << std::endl;
+  return counts;
+}
+
+// Function to return a counterclockwise ring through the given points
+static Polygon ring(const std::vector<Point> &points)
+{
+  Polygon pgn(points.begin(), points.end());
+  if (pgn.is_clockwise_oriented()) {
+    pgn.reverse_orientation();
+  }
+  return pgn;
+}
+
+// Function to add a GeoDiv with the given polygons to the inset. Its target
+// area is its area, so that the GeoDiv keeps its size.
+static void add_geo_div(
+  InsetState &inset_state,
+  const std::string &id,
+  const std::vector<Polygon_with_holes> &polygons_with_holes)
+{
+  inset_state.insert_target_area(id, 0.0);
+  GeoDiv gd(id, inset_state.id_index(id));
+  for (const auto &pwh : polygons_with_holes) {
+    gd.push_back(pwh);
+  }
+  inset_state.push_back(gd);
+  inset_state.replace_target_area(id, inset_state.geo_divs().back().area());
+}
+
+// Function to add four GeoDivs to the inset: a square with a hole, a
+// rectangle that shares an edge with the square, a GeoDiv of two parts and a
+// GeoDiv with many points and a long ID, which does not fit into the
+// small-string buffer of std::string
+static void add_synthetic_geo_divs(InsetState &inset_state)
+{
+  Polygon hole = ring({{1.0, 1.0}, {2.0, 1.0}, {2.0, 2.0}, {1.0, 2.0}});
+  hole.reverse_orientation();
+  const std::vector<Polygon> holes = {hole};
+  add_geo_div(
+    inset_state,
+    "A",
+    {Polygon_with_holes(
+      ring({{0.0, 0.0}, {4.0, 0.0}, {4.0, 4.0}, {0.0, 4.0}}),
+      holes.begin(),
+      holes.end())});
+  add_geo_div(
+    inset_state,
+    "B",
+    {Polygon_with_holes(
+      ring({{4.0, 0.0}, {10.0, 0.0}, {10.0, 4.0}, {4.0, 4.0}}))});
+  add_geo_div(
+    inset_state,
+    "C",
+    {Polygon_with_holes(ring({{0.0, 5.0}, {5.0, 5.0}, {2.5, 9.0}})),
+     Polygon_with_holes(
+       ring({{7.0, 6.0}, {9.0, 6.0}, {9.0, 8.0}, {7.0, 8.0}}))});
+  std::vector<Point> circle;
+  constexpr unsigned int n_circle_points = 1000;
+  for (unsigned int k = 0; k < n_circle_points; ++k) {
+    const double phi = 2 * std::numbers::pi * k / n_circle_points;
+    circle.emplace_back(5 + 3 * std::cos(phi), -5 + 3 * std::sin(phi));
+  }
+  add_geo_div(
+    inset_state,
+    "GeoDiv with a long identifier",
+    {Polygon_with_holes(ring(circle))});
+
+  // As at the end of CartogramInfo::read_geojson()
+  inset_state.sync_flat_geo_divs();
+}
+
+static std::string rasterizer_name(const DensityRasterizer rasterizer)
+{
+  switch (rasterizer) {
+  case DensityRasterizer::adaptive:
+    return "adaptive";
+  case DensityRasterizer::exact:
+    return "exact";
+  default:
+    return "scanline";
+  }
+}
+
+int main()
+{
+  init_fftw_threads(0);
+  unsigned long n_failures = 0;
+  unsigned long n_stages = 0;
+  for (const bool multi_rate : {false, true}) {
+    for (const IntegrationMethod method :
+         {IntegrationMethod::midpoint, IntegrationMethod::dormand_prince}) {
+      const std::unique_ptr<Integrator> integrator =
+        make_integrator(method, multi_rate);
+      for (const DensityRasterizer rasterizer :
+           {DensityRasterizer::scanline,
+            DensityRasterizer::adaptive,
+            DensityRasterizer::exact}) {
+
+        // Set up the inset as in main()
+        InsetState inset_state("C");
+        inset_state.set_inset_name("test_allocations");
+        add_synthetic_geo_divs(inset_state);
+        inset_state.rescale_map(128, false);
+        inset_state.ref_to_rho_init()->allocate(
+          inset_state.lx(),
+          inset_state.ly());
+        inset_state.ref_to_rho_ft()->allocate(
+          inset_state.lx(),
+          inset_state.ly());
+        inset_state.make_fftw_plans_for_rho(FFTW_ESTIMATE);
+        inset_state.initialize_cum_proj();
+        inset_state.set_area_errors();
+        inset_state.store_initial_area();
+        inset_state.normalize_target_area();
+        integrate(inset_state, *integrator, rasterizer);
+        const std::vector<stage_allocations> counts =
+          integrate(inset_state, *integrator, rasterizer);
+        for (const auto &[stage, n] : counts) {
+          ++n_stages;
+          if (n > 0) {
+            ++n_failures;
+            std::cerr << "Integrator " << integrator->name()
+                      << (multi_rate ? " (multi-rate)" : "")
+                      << ", rasterizer " << rasterizer_name(rasterizer)
+                      << ": " << n << " allocations in " << stage << "()"
+                      << std::endl;
+          }
+        }
+        inset_state.destroy_fftw_plans_for_rho();
+        inset_state.ref_to_rho_init()->free();
+        inset_state.ref_to_rho_ft()->free();
+      }
+    }
+  }
+  std::cout << n_stages << " stages tested, " << n_failures
+            << " with allocations" << std::endl;
+  return (n_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,185 @@
+// Test that BilinearInterpolator and VelocityField return the same results
+// as the reference implementation interpolate_bilinearly() for every
+// instruction set that the CPU supports. The grids have random dimensions
+// and values. Besides random points, every grid point, every cell corner and
+// the points on the boundary of the domain are tested.
+// Usage: test_bilinear_interpolator [n_grids]
+// BilinearInterpolator must be bit-identical to the reference. The velocity
+// field may differ in the sign of zero: the reference interpolates +0 on the
+// boundaries, where the velocity field evaluates -0 / rho.
+
+#include "bilinear_interpolator.h"
+#include "interpolate_bilinearly.h"
+#include <bit>
+#include <boost/multi_array.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string instruction_set_name(const InstructionSet instruction_set)
+{
+  switch (instruction_set) {
+  case InstructionSet::avx2:
+    return "avx2";
+  case InstructionSet::avx512f:
+    return "avx512f";
+  default:
+    return "baseline";
+  }
+}
+
+static bool is_bit_identical(const double a, const double b)
+{
+  return std::bit_cast<std::uint64_t>(a) == std::bit_cast<std::uint64_t>(b);
+}
+
+// Points at which the grids are compared: random points in the domain, the
+// grid points x = 0.5, 1.5, ..., the cell corners x = 0, 1, ..., lx (which
+// include the boundary) and points just inside the boundary
+static std::vector<XYPoint> test_points(
+  const unsigned int lx,
+  const unsigned int ly,
+  std::mt19937 &rng)
+{
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (unsigned int i = 0; i <= 2 * lx; ++i) {
+    xs.push_back(0.5 * i);
+  }
+  for (unsigned int j = 0; j <= 2 * ly; ++j) {
+    ys.push_back(0.5 * j);
+  }
+  for (const double eps : {1e-12, 0.25}) {
+    xs.insert(xs.end(), {eps, lx - eps});
+    ys.insert(ys.end(), {eps, ly - eps});
+  }
+  std::vector<XYPoint> points;
+  for (const double x : xs) {
+    for (const double y : ys) {
+      points.emplace_back(x, y);
+    }
+  }
+  std::uniform_real_distribution<double> ux(0.0, lx);
+  std::uniform_real_distribution<double> uy(0.0, ly);
+  for (unsigned int k = 0; k < 1000; ++k) {
+    points.emplace_back(ux(rng), uy(rng));
+  }
+  return points;
+}
+
+int main(const int argc, const char *argv[])
+{
+  const unsigned int n_grids = (argc > 1) ? std::atoi(argv[1]) : 200;
+  std::mt19937 rng(20240601);
+  std::uniform_int_distribution<unsigned int> grid_length(1, 48);
+  std::uniform_real_distribution<double> value(-10.0, 10.0);
+  std::uniform_real_distribution<double> density(0.1, 10.0);
+  std::uniform_real_distribution<double> time(0.0, 1.0);
+  unsigned long n_failures = 0;
+  unsigned long n_comparisons = 0;
+  const std::vector<InstructionSet> instruction_sets =
+    supported_instruction_sets();
+  for (unsigned int grid = 0; grid < n_grids; ++grid) {
+    const unsigned int lx = grid_length(rng);
+    const unsigned int ly = grid_length(rng);
+    boost::multi_array<double, 2> gx(boost::extents[lx][ly]);
+    boost::multi_array<double, 2> gy(boost::extents[lx][ly]);
+    boost::multi_array<double, 2> fluxx(boost::extents[lx][ly]);
+    boost::multi_array<double, 2> fluxy(boost::extents[lx][ly]);
+    boost::multi_array<double, 2> rho_init(boost::extents[lx][ly]);
+    BilinearInterpolator interpolator(lx, ly);
+    VelocityField velocity_field(lx, ly);
+    const double rho_ft_00 = density(rng);
+    velocity_field.set_rho_ft_00(rho_ft_00);
+    for (unsigned int i = 0; i < lx; ++i) {
+      for (unsigned int j = 0; j < ly; ++j) {
+        gx[i][j] = value(rng);
+        gy[i][j] = value(rng);
+        fluxx[i][j] = value(rng);
+        fluxy[i][j] = value(rng);
+        rho_init[i][j] = density(rng);
+        interpolator.set_values(i, j, gx[i][j], gy[i][j]);
+        velocity_field.set_values(
+          i,
+          j,
+          fluxx[i][j],
+          fluxy[i][j],
+          rho_init[i][j]);
+      }
+    }
+    interpolator.pad_boundaries();
+    velocity_field.pad_boundaries();
+
+    // Velocity on the whole grid at time t, as computed before the velocity
+    // field was evaluated on demand
+    const double t = time(rng);
+    boost::multi_array<double, 2> vx(boost::extents[lx][ly]);
+    boost::multi_array<double, 2> vy(boost::extents[lx][ly]);
+    for (unsigned int i = 0; i < lx; ++i) {
+      for (unsigned int j = 0; j < ly; ++j) {
+        const double rho = rho_ft_00 + (1.0 - t) * (rho_init[i][j] - rho_ft_00);
+        vx[i][j] = -fluxx[i][j] / rho;
+        vy[i][j] = -fluxy[i][j] / rho;
+      }
+    }
+    const std::vector<XYPoint> points = test_points(lx, ly, rng);
+    std::vector<XYPoint> interpolated(points.size());
+    std::vector<XYPoint> velocities(points.size());
+    for (const InstructionSet instruction_set : instruction_sets) {
+      use_instruction_set(instruction_set);
+      interpolator.interpolate(
+        points.data(),
+        interpolated.data(),
+        points.size());
+      velocity_field.velocity(
+        t,
+        points.data(),
+        velocities.data(),
+        points.size());
+      for (std::size_t k = 0; k < points.size(); ++k) {
+        const double x = points[k].x;
+        const double y = points[k].y;
+        const XYPoint single = interpolator.interpolate(x, y);
+        const XYPoint expected(
+          interpolate_bilinearly(x, y, &gx, 'x', lx, ly),
+          interpolate_bilinearly(x, y, &gy, 'y', lx, ly));
+        const XYPoint expected_velocity(
+          interpolate_bilinearly(x, y, &vx, 'x', lx, ly),
+          interpolate_bilinearly(x, y, &vy, 'y', lx, ly));
+        const bool passed =
+          is_bit_identical(interpolated[k].x, expected.x) &&
+          is_bit_identical(interpolated[k].y, expected.y) &&
+          is_bit_identical(single.x, expected.x) &&
+          is_bit_identical(single.y, expected.y) &&
+          velocities[k].x == expected_velocity.x &&
+          velocities[k].y == expected_velocity.y;
+        ++n_comparisons;
+        if (!passed) {
+          ++n_failures;
+          if (n_failures <= 10) {
+            std::cerr.precision(17);
+            std::cerr << "Mismatch (" << instruction_set_name(instruction_set)
+                      << ", grid " << lx << "x" << ly << ") at (" << x << ", "
+                      << y << "): interpolated (" << interpolated[k].x << ", "
+                      << interpolated[k].y << "), expected (" << expected.x
+                      << ", " << expected.y << "); velocity ("
+                      << velocities[k].x << ", " << velocities[k].y
+                      << "), expected (" << expected_velocity.x << ", "
+                      << expected_velocity.y << ")" << std::endl;
+          }
+        }
+      }
+    }
+  }
+  std::cout << "Instruction sets:";
+  for (const InstructionSet instruction_set : instruction_sets) {
+    std::cout << " " << instruction_set_name(instruction_set);
+  }
+  std::cout << "\n"
+            << n_comparisons << " points compared, " << n_failures
+            << " mismatches" << std::endl;
+  return (n_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}